@@ -7,9 +7,10 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "metadata_pair.h"
+#include "config.h"
 #include "acs.h"
 #include "acs_commands.h"
-#include "metadata_pair.h"
 #include "debug.h"
 
 /** @file acs.c
@@ -18,6 +19,9 @@
  * Handle ACS communication, generate JSON data structes and send the
  * commands using cURL to the ACS server. Provide methods of error checking
  * the communication.
+ *
+ * The settings are read from the config snapshot given by the caller, which
+ * never changes while it is in use, so no locking is needed.
  */
 
 /******************** MACRO DEFINITION SECTION ********************************/
@@ -25,14 +29,6 @@
 
 /******************** LOCAL VARIABLE DECLARATION SECTION **********************/
 
-typedef struct acs
-{
-    gchar *username;
-    gchar *password;
-    gchar *ipname;
-    gchar *source;
-    gchar *enabled;
-} acs;
 
 /******************** LOCAL FUNCTION DECLARATION SECTION **********************/
 
@@ -46,35 +42,25 @@ typedef struct acs
  */
 static gboolean check_jSON_response(const char *buffer, char **error);
 
-static gboolean is_initialized(const acs_handle handle)
-{
-    if (handle == NULL) {
-        return FALSE;
-    }
-
-    if (handle->enabled == NULL || g_strcmp0(handle->enabled, "yes") != 0) {
-        return FALSE;
-    }
-
-    if (handle->username == NULL) {
-        return FALSE;
-    }
-
-    if (handle->password == NULL) {
-        return FALSE;
-    }
-
-    if (handle->ipname == NULL) {
-        return FALSE;
-    }
-
-    if (handle->source == NULL) {
-        return FALSE;
-    }
-
-    return TRUE;
-}
+/**
+ * Append a string escaped for use inside a JSON string literal which in
+ * turn sits inside a single quoted shell argument.
+ *
+ * @param command The command being built.
+ * @param string  The string to append.
+ *
+ * @return No return value.
+ */
+static void append_json_string(GString *command, const char *string);
 
+/**
+ * Check that all settings needed to report are configured.
+ *
+ * @param cfg The config snapshot.
+ *
+ * @return TRUE if reporting is enabled and configured, FALSE otherwise.
+ */
+static gboolean is_initialized(const config *cfg);
 
 /******************** LOCAL FUNCTION DEFINTION SECTION ************************/
 
@@ -116,136 +102,180 @@ static gboolean check_jSON_response(const char *buffer, char **error)
     return ret;
 }
 
-/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
-
 /**
- * Initialize MDP information
+ * Append a string escaped for JSON and the single quoted shell argument.
  */
-acs_handle acs_init()
+static void append_json_string(GString *command, const char *string)
 {
-    acs_handle handle = g_new0(acs, 1);
-
-    return handle;
+    const char *c = string;
+
+    for (; *c != '\0'; c++) {
+        switch (*c) {
+        case '"':
+            g_string_append(command, "\\\"");
+            break;
+        case '\\':
+            g_string_append(command, "\\\\");
+            break;
+        case '\'':
+            /* Close the shell quote, add an escaped quote and reopen */
+            g_string_append(command, "'\\''");
+            break;
+        default:
+            if ((guchar) *c < 0x20) {
+                g_string_append(command, "\\u00");
+                g_string_append_c(command, "0123456789abcdef"[*c >> 4]);
+                g_string_append_c(command, "0123456789abcdef"[*c & 0xf]);
+            } else {
+                g_string_append_c(command, *c);
+            }
+            break;
+        }
+    }
 }
 
 /**
- * Cleanup MDP
+ * Check that all settings needed to report are configured.
  */
-void acs_cleanup(acs_handle *handle_p)
+static gboolean is_initialized(const config *cfg)
 {
-    if (handle_p == NULL) {
-        return;
+    if (cfg == NULL) {
+        return FALSE;
+    }
+
+    if (cfg->enabled == NULL || g_strcmp0(cfg->enabled, "yes") != 0) {
+        return FALSE;
     }
 
-    if (*handle_p == NULL) {
-        return;
+    if (cfg->username == NULL) {
+        return FALSE;
     }
 
-    acs_handle handle = *handle_p;
+    if (cfg->password == NULL) {
+        return FALSE;
+    }
 
-    g_free(handle->username);
-    g_free(handle->password);
-    g_free(handle->ipname);
-    g_free(handle->source);
-    g_free(handle->enabled);
+    if (cfg->ipname == NULL) {
+        return FALSE;
+    }
 
-    g_free(handle);
+    if (cfg->source == NULL) {
+        return FALSE;
+    }
 
-    handle_p = NULL;
+    return TRUE;
 }
 
+/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
+
 /**
-*  Send Metadata to ACS
-*/
-gboolean acs_run(const acs_handle handle,
-                 GList *metadata_items,
-                 char **error)
+ * Encode metadata into an ACS command. Only appends to the command buffer,
+ * which stops allocating once it has grown to the size of a command.
+ */
+gboolean acs_encode(const config *cfg,
+                    const char *source,
+                    const mdp_record *metadata_items,
+                    gint64 timestamp,
+                    GString *command)
 {
-    gchar **data_items     = NULL;
-    gchar *jSON_string     = NULL;
-    gchar *tmp_concat      = NULL;
-    GList *overlay_data    = NULL;
+    g_assert(command);
 
-    char *cmd    = NULL;
-    gboolean ret = TRUE;
+    g_string_truncate(command, 0);
 
-    if (is_initialized(handle) == FALSE) {
-        if (error) {
-            *error = g_strdup("Missing config");
-        }
+    if (is_initialized(cfg) == FALSE) {
         return FALSE;
     }
 
     /**
-     * Retrieve current UTC time as needed by the API
+     * Convert the time of the event to UTC as needed by the API
      */
     char outstr[200];
     time_t t;
+    struct tm tm_utc;
     struct tm *tmp;
 
-    t = time(NULL);
-    tmp = gmtime(&t);
+    t = (time_t) (timestamp / G_USEC_PER_SEC);
+    tmp = gmtime_r(&t, &tm_utc);
 
 
     if (tmp == NULL) {
         ERR("Failed to get time value");
-        goto cleanup;
+        return FALSE;
     }
 
     if (strftime(outstr, sizeof(outstr), "%F %T", tmp) == 0) {
         ERR("Failed to convert time");
-        goto cleanup;
+        return FALSE;
     }
 
     /* Boilerplate JSON command structure */
-    jSON_string = g_strdup_printf(\
-        "{ \
-            \"addExternalDataRequest\": \
-                { \"occurrenceTime\": \"%s\",\
-                  \"source\": \"%s\",\
-                  \"externalDataType\": \
-                  \"PointOfSales\", \"data\": {", outstr, handle->source);
-
-    GList *list = metadata_items;
-    for (; list != NULL; list = list->next) {
+    g_string_append(command, METABASE_DATA);
+    g_string_append(command, JSON_TIME);
+    g_string_append(command, outstr);
+    g_string_append(command, JSON_SOURCE);
+    append_json_string(command, source != NULL ? source : cfg->source);
+    g_string_append(command, JSON_DATA);
+
+    guint i = 0;
+    for (; i < mdp_record_size(metadata_items); i++) {
         /* Create JSON data entry and append to jSON string */
-        mdp_item_pair *item_pair = list->data;
-
-        gchar *item_string = g_strdup_printf("\"%s\":\"%s\",",
-            item_pair->name, item_pair->value);
+        gchar buffer[MDP_FORMAT_SIZE];
+        const gchar *value = mdp_record_format(metadata_items, i, buffer);
 
-        overlay_data = g_list_append(
-            overlay_data, g_strdup(item_string));
+        if (i > 0) {
+            g_string_append_c(command, ',');
+        }
 
-        tmp_concat = g_strconcat(jSON_string, item_string, NULL);
+        g_string_append_c(command, '"');
+        append_json_string(command, mdp_record_name(metadata_items, i));
+        /**
+         * The external data of ACS is a set of string key-value pairs, its
+         * search matches on the text, so every value is sent quoted. Doubles
+         * are sent in their shortest exact form, 1.5 and not 1.500000 as
+         * before typed values.
+         */
+        g_string_append(command, "\":\"");
+        append_json_string(command, value);
+        g_string_append_c(command, '"');
+    }
 
-        g_free(item_string);
-        g_free(jSON_string);
+    g_string_append(command, JSON_END);
+    g_string_append(command, METABASE_HOST);
+    g_string_append(command, cfg->ipname);
+    g_string_append(command, METABASE_USER);
+    g_string_append(command, cfg->username);
+    g_string_append_c(command, ':');
+    g_string_append(command, cfg->password);
+    g_string_append(command, METABASE_END);
 
-        jSON_string = tmp_concat;
-    }
+    return TRUE;
+}
 
-    tmp_concat = g_strconcat(jSON_string, "}}}", NULL);
-    g_free(jSON_string);
-    jSON_string = tmp_concat;
+/**
+ * Send an encoded command to ACS.
+ */
+gboolean acs_send(const char *command, char **error)
+{
+    gboolean ret = TRUE;
 
-    cmd = g_strdup_printf(METABASE, jSON_string, handle->ipname,
-                          handle->username, handle->password);
+    if (command == NULL) {
+        return FALSE;
+    }
 
     /**
      * Only perform blocking call if we are checking for error (test reporting).
-     * We need to perform a non-blocking call during normal operation because
-     * this function will be run in the GMainLoop context.
+     * During normal operation this runs on the pipeline threads and a
+     * non-blocking call keeps the pipeline from waiting on the server.
      *
-     * TODO: Look at using worker threads, libcurl etc. if we want error
-     * checking for each metadata upload. Possible create an event so user can
-     * be notified of reporting errors.
+     * TODO: Look at using libcurl etc. if we want error checking for each
+     * metadata upload. Possible create an event so user can be notified of
+     * reporting errors.
      */
     if (error) {
         gchar *stdout;
         gchar *stderr;
 
-        (void) g_spawn_command_line_sync(cmd,
+        (void) g_spawn_command_line_sync(command,
             &stdout, &stderr, NULL, NULL);
 
         ret = check_jSON_response(stdout, error);
@@ -255,189 +285,34 @@ gboolean acs_run(const acs_handle handle,
     } else {
         /* Send JSON command, return value is not useful */
         DBG_LOG("Pushing command to ACS");
-        (void) g_spawn_command_line_async(cmd, NULL);
+        (void) g_spawn_command_line_async(command, NULL);
     }
 
-cleanup:
-    g_free(jSON_string);
-    g_strfreev(data_items);
-    g_free(cmd);
-
     return ret;
 }
 
 /**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-void acs_set_username(const acs_handle handle, const char *username)
-{
-    if (handle == NULL) {
-        return;
-    }
-
-    g_free(handle->username);
-    handle->username = g_strdup(username);
-}
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-void acs_set_password(const acs_handle handle, const char *password)
-{
-    if (handle == NULL) {
-        return;
-    }
-
-    g_free(handle->password);
-    handle->password = g_strdup(password);
-}
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-void acs_set_ipname(const acs_handle handle, const char *ipname)
-{
-    if (handle == NULL) {
-        return;
-    }
-
-    g_free(handle->ipname);
-    handle->ipname = g_strdup(ipname);
-}
-
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-void acs_set_source(const acs_handle handle, const char *source)
-{
-    if (handle == NULL) {
-        return;
-    }
-
-    g_free(handle->source);
-    handle->source = g_strdup(source);
-}
-
-void acs_set_enabled(const acs_handle handle, const char *enabled)
-{
-    if (handle == NULL) {
-        return;
-    }
-
-    g_free(handle->enabled);
-    handle->enabled = g_strdup(enabled);
-}
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-const char * acs_get_username(const acs_handle handle)
-{
-    if (handle == NULL) {
-        return NULL;
-    }
-
-    return handle->username;
-}
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-const char * acs_get_password(const acs_handle handle)
+*  Send Metadata to ACS
+*/
+gboolean acs_run(const config *cfg,
+                 const mdp_record *metadata_items,
+                 char **error)
 {
-    if (handle == NULL) {
-        return NULL;
-    }
-
-    return handle->password;
-}
+    GString *cmd = g_string_new(NULL);
+    gboolean ret = FALSE;
 
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-const char * acs_get_ipname(const acs_handle handle)
-{
-    if (handle == NULL) {
-        return NULL;
+    if (acs_encode(cfg, NULL, metadata_items, g_get_real_time(),
+        cmd) == FALSE) {
+        if (error) {
+            *error = g_strdup("Missing config");
+        }
+        g_string_free(cmd, TRUE);
+        return FALSE;
     }
 
-    return handle->ipname;
-}
+    ret = acs_send(cmd->str, error);
 
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-const char * acs_get_source(const acs_handle handle)
-{
-    if (handle == NULL) {
-        return NULL;
-    }
+    g_string_free(cmd, TRUE);
 
-    return handle->source;
+    return ret;
 }
-
-const char * acs_get_enabled(const acs_handle handle)
-{
-    if (handle == NULL) {
-        return NULL;
-    }
-
-    return handle->enabled;
-}
\ No newline at end of file
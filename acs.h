@@ -6,149 +6,55 @@
  *
  * Handle ACS communication, generate JSON data structes and send the
  * commands using cURL to the ACS server. Provide methods of error checking
- * the communication.
+ * the communication. Server address, credentials and source are taken from
+ * a config snapshot.
  */
 
-/**
- * Forward-declared handle for ACS object.
- */
-typedef struct acs* acs_handle;
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-acs_handle acs_init();
-
-/**
- * Cleanup Metadata Push framework and deallocate resources.
- *
- * @return No return value.
- */
-void acs_cleanup(acs_handle *handle_p);
-
 /**
  * Send Metadata to ACS.
  *
- * @param key_value_set  The set of metadata that should be pushed to ACS.
- * @param par_items      List of semi-colon separated values with item names to
- *						 to look up and put into JSON structure.
+ * @param cfg            Config snapshot with the ACS settings.
+ * @param metadata_items Record of metadata items to put into the JSON structure.
  * @param error          Location to place error message. If NULL this will be
  *                       ignored AND ACS send opteration will be non-blocking
  *                       which must be done from a event callback context.
  *
  * @return TRUE on success, FALSE on any kind of error.
  */
-gboolean acs_run(const acs_handle handle,
-				 GList *metadata_items,
+gboolean acs_run(const config *cfg,
+				 const mdp_record *metadata_items,
 	             char **error);
 
 /**
- * Initialize Metadata Push framework.
+ * Encode metadata into an ACS command without sending it. Safe to call from
+ * several threads at once.
  *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
+ * @param cfg            Config snapshot with the ACS settings.
+ * @param source         Source ID to report the event as, NULL for the
+ *                       SourceID of the config.
+ * @param metadata_items Record of metadata items to put into the JSON structure.
+ * @param timestamp      Time the event occurred, in microseconds since the
+ *                       Unix epoch as from g_get_real_time().
+ * @param command        Buffer the command is written to, reused between
+ *                       calls so it only grows until it fits a command.
  *
- * @return No return value.
+ * @return TRUE on success, FALSE if ACS is not configured or enabled.
  */
-void acs_set_username(const acs_handle handle, const char *username);
+gboolean acs_encode(const config *cfg,
+                    const char *source,
+                    const mdp_record *metadata_items,
+                    gint64 timestamp,
+                    GString *command);
 
 /**
- * Initialize Metadata Push framework.
+ * Send an encoded command to ACS.
  *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
+ * @param command The command from acs_encode().
+ * @param error   Location to place error message. If NULL this will be
+ *                ignored AND ACS send operation will be non-blocking.
  *
- * @return No return value.
- */
-void acs_set_password(const acs_handle handle, const char *password);
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-void acs_set_ipname(const acs_handle handle, const char *ipname);
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-void acs_set_source(const acs_handle handle, const char *source);
-
-void acs_set_enabled(const acs_handle handle, const char *enabled);
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-const char * acs_get_username(const acs_handle handle);
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-const char * acs_get_password(const acs_handle handle);
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
- */
-const char * acs_get_ipname(const acs_handle handle);
-
-/**
- * Initialize Metadata Push framework.
- *
- * @param username  Username for the ACS server.
- * @param password  Password for the ACS server.
- * @param acs_ip    IP Address for the ACS server.
- * @param source_id Source Key to use for the Metadata.
- *
- * @return No return value.
+ * @return TRUE on success, FALSE on any kind of error.
  */
-const char * acs_get_source(const acs_handle handle);
-
-const char * acs_get_enabled(const acs_handle handle);
-
-
+gboolean acs_send(const char *command, char **error);
 
-#endif // INCLUSION_GUARD_ACS_H
\ No newline at end of file
+#endif // INCLUSION_GUARD_ACS_H
@@ -8,12 +8,23 @@
  */
 
 /**
- * Macro used to form the cURL command used when communicating with ACS.
- *
+ * Parts of the cURL command used when communicating with ACS. The command is
+ * appended piece by piece in the order: METABASE_DATA, JSON data,
+ * METABASE_HOST, ip, METABASE_USER, username, ':', password, METABASE_END.
+ */
+#define METABASE_DATA "curl --insecure --anyauth -H \"Content-Type: application/json\
+\" --data \'"
+#define METABASE_HOST "\' -sw 'HTTP:%{http_code}' --max-time 2 https://"
+#define METABASE_USER "/Acs/Api/ExternalDataFacade/AddExternalData  --user \""
+#define METABASE_END  "\""
+
+/**
+ * Parts of the JSON data, the occurrence time, source and data items go in
+ * between.
  */
-#define METABASE "curl --insecure --anyauth -H \"Content-Type: application/json\
-\" --data \'%s\' -sw 'HTTP:%%{http_code}' --max-time 2 https://%s/A\
-cs/Api/ExternalDataFacade/AddExternalData  --user \"%s:%s\"\
-"
+#define JSON_TIME   "{ \"addExternalDataRequest\": { \"occurrenceTime\": \""
+#define JSON_SOURCE "\", \"source\": \""
+#define JSON_DATA   "\", \"externalDataType\": \"PointOfSales\", \"data\": {"
+#define JSON_END    "}}}"
 
 #endif // INCLUSION_GUARD_ACS_COMMANDS_H
\ No newline at end of file
@@ -468,23 +468,36 @@ camera_param_setCallback(const char* name, CAMERA_PARAM_callback theCallback)
 
 const char*
 camera_param_get(const char* param_name, char* value, int max_count)
+{
+  gchar  *param_value = camera_param_dup(param_name);
+
+  if( !param_value ) {
+	  value[0]=0;
+	  return 0;
+  }
+
+  g_strlcpy(value, param_value, max_count);
+  g_free( param_value);
+
+  return value;
+}
+
+char*
+camera_param_dup(const char* param_name)
 {
   gchar  *param_value = NULL;
 
   if( !handler_application_param ) {
 	  LOG_ERROR("Camera: Cannot get parameter %s (handler not initialized)\n", param_name);
-	  return 0;
+	  return NULL;
   }
 
   if (!ax_parameter_get(handler_application_param, param_name, &param_value, NULL)) {
-	  LOG_ERROR("Camera: Cannot get parameter %s (internal errro)\n", param_name);
-	  value[0]=0;
-	  return 0;
+	  LOG_ERROR("Camera: Cannot get parameter %s (internal error)\n", param_name);
+	  return NULL;
   }
-  g_strlcpy(value, param_value, max_count);
-  g_free( param_value);
 
-  return value;
+  return param_value;
 }
 
 int
@@ -63,6 +63,7 @@ int  camera_event_send(const char* event_id,int value,const char* event_data);
 
 int  camera_param_setCallback(const char* name, CAMERA_PARAM_callback theCallback);
 const char* camera_param_get(const char* name, char *return_value, int max_count); //Returns the pointer to return_value or NULL if paramter does not exist
+char* camera_param_dup(const char* name); //Returns the full value, free with g_free, or NULL if paramter does not exist
 int  camera_param_set(const char* name,const char* value);
 
 #ifdef  __cplusplus
@@ -0,0 +1,219 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gprintf.h>
+
+#include <syslog.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "channel_map.h"
+#include "content_filter.h"
+#include "debug.h"
+
+/** @file channel_map.c
+ * @Brief Implementation of the channel map.
+ *
+ * The channel key is looked up with the same lookup functions as the
+ * content filter, with its last seen type as hint, so both events and
+ * ingested records can carry a channel. Source IDs are interned, records
+ * in the pipeline keep pointing at them after the map is replaced.
+ */
+
+/******************** LOCAL VARIABLE DECLARATION SECTION **********************/
+
+typedef struct channel_map
+{
+    gint                ref_count;
+    gchar               *key;
+    content_filter_type type;
+    const gchar         *sources[MAX_CHANNELS + 1];
+} channel_map;
+
+/******************** LOCAL FUNCTION DECLARATION SECTION **********************/
+
+/**
+ * Parse a channel number.
+ *
+ * @param text    The text to parse.
+ * @param channel Return location for the channel number.
+ *
+ * @return TRUE if the text is a channel number, FALSE otherwise.
+ */
+static gboolean parse_channel(const gchar *text, guint *channel);
+
+/******************** LOCAL FUNCTION DEFINTION SECTION ************************/
+
+/**
+ * Parse a channel number, the whole text must be a number in range.
+ */
+static gboolean parse_channel(const gchar *text, guint *channel)
+{
+    gchar *end    = NULL;
+    guint64 value = g_ascii_strtoull(text, &end, 10);
+
+    if (end == text || *end != '\0' || value < 1 || value > MAX_CHANNELS) {
+        return FALSE;
+    }
+
+    *channel = (guint) value;
+
+    return TRUE;
+}
+
+/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
+
+/**
+ * Compile channel map.
+ */
+channel_map_handle channel_map_init(const char *key,
+                                    const char *sources,
+                                    char **error)
+{
+    g_assert(error);
+
+    if (key == NULL) {
+        return NULL;
+    }
+
+    gchar *channel_key = g_strstrip(g_strdup(key));
+
+    if (*channel_key == '\0') {
+        g_free(channel_key);
+        return NULL;
+    }
+
+    channel_map_handle handle = g_new0(channel_map, 1);
+    handle->ref_count         = 1;
+    handle->key               = channel_key;
+    handle->type              = CONTENT_FILTER_TYPE_INTEGER;
+
+    gchar **pairs = g_strsplit(sources != NULL ? sources : "", ";", -1);
+
+    guint i = 0;
+    for (; pairs[i] != NULL; i++) {
+        gchar *pair   = g_strstrip(pairs[i]);
+        guint channel = 0;
+
+        if (*pair == '\0') {
+            continue;
+        }
+
+        gchar *source = strchr(pair, '=');
+
+        if (source != NULL) {
+            *source++ = '\0';
+            source    = g_strstrip(source);
+        }
+
+        if (source == NULL || *source == '\0' ||
+            !parse_channel(g_strstrip(pair), &channel)) {
+            *error = g_strdup_printf("Bad channel sources '%s'", sources);
+            g_strfreev(pairs);
+            channel_map_cleanup(&handle);
+            return NULL;
+        }
+
+        handle->sources[channel] = g_intern_string(source);
+    }
+
+    g_strfreev(pairs);
+
+    return handle;
+}
+
+/**
+ * Take a reference to a channel map.
+ */
+channel_map_handle channel_map_ref(const channel_map_handle handle)
+{
+    if (handle != NULL) {
+        g_atomic_int_inc(&handle->ref_count);
+    }
+
+    return handle;
+}
+
+/**
+ * Drop a reference, cleanup channel map with the last one.
+ */
+void channel_map_cleanup(channel_map_handle *handle_p)
+{
+    if (handle_p == NULL) {
+        return;
+    }
+
+    if (*handle_p == NULL) {
+        return;
+    }
+
+    channel_map_handle handle = *handle_p;
+
+    *handle_p = NULL;
+
+    if (!g_atomic_int_dec_and_test(&handle->ref_count)) {
+        return;
+    }
+
+    g_free(handle->key);
+    g_free(handle);
+}
+
+/**
+ * Look up the channel key. Channel numbers are usually integers, but a
+ * string or a whole double holding the number is accepted too.
+ */
+guint channel_map_resolve(const channel_map_handle handle,
+                          content_filter_lookup lookup,
+                          gpointer user_data,
+                          const gchar **source)
+{
+    g_assert(source);
+
+    *source = NULL;
+
+    if (handle == NULL || lookup == NULL) {
+        return 0;
+    }
+
+    content_filter_value value = { .type = handle->type };
+    guint channel              = 0;
+    gboolean valid             = FALSE;
+
+    if (!lookup(handle->key, &value, user_data)) {
+        DBG_LOG("No channel key %s", handle->key);
+        return 0;
+    }
+
+    handle->type = value.type;
+
+    switch (value.type) {
+    case CONTENT_FILTER_TYPE_STRING:
+        valid = parse_channel(value.string, &channel);
+        content_filter_value_clear(&value);
+        break;
+    case CONTENT_FILTER_TYPE_INTEGER:
+        if (value.integer >= 1 && value.integer <= MAX_CHANNELS) {
+            channel = (guint) value.integer;
+            valid   = TRUE;
+        }
+        break;
+    case CONTENT_FILTER_TYPE_DOUBLE:
+        if (value.number >= 1 && value.number <= MAX_CHANNELS) {
+            channel = (guint) value.number;
+            valid   = value.number == channel;
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (!valid) {
+        DBG_LOG("No valid channel in %s", handle->key);
+        return 0;
+    }
+
+    *source = handle->sources[channel];
+
+    return channel;
+}
@@ -0,0 +1,80 @@
+#ifndef INCLUSION_GUARD_CHANNEL_MAP_H
+#define INCLUSION_GUARD_CHANNEL_MAP_H
+
+#include <glib.h>
+
+#include "content_filter.h"
+
+/** @file channel_map.h
+ * @Brief Mapping of events to camera channels.
+ *
+ * On multi-sensor and multi-view-area cameras one subscription gets the
+ * events of all channels. The channel of an event is read from one of its
+ * keys, a topic key or a data item, holding the channel number. Each
+ * channel can report to ACS with its own source ID and gets its own
+ * overlay. Events without a valid channel number are channel 0, shown on
+ * all channels and reported with the configured SourceID.
+ */
+
+/**
+ * Highest channel number, channels are numbered from 1 like the cameras.
+ */
+#define MAX_CHANNELS (16)
+
+/**
+ * Forward-declared handle for channel map object.
+ */
+typedef struct channel_map* channel_map_handle;
+
+/**
+ * Compile a channel map.
+ *
+ * @param key     Key holding the channel number, " " or empty for no
+ *                channels.
+ * @param sources Semi-colon separated list of channel=source ID pairs, e.g.
+ *                1=11001;2=11002; Channels not listed use the SourceID.
+ * @param error   Mandatory location to place error message on failure.
+ *
+ * @return Handle for the compiled map, NULL if channels are not used or on
+ *         failure, with error set.
+ */
+channel_map_handle channel_map_init(const char *key,
+                                    const char *sources,
+                                    char **error);
+
+/**
+ * Take a reference to a channel map. Safe to call from any thread.
+ *
+ * @param handle The map, may be NULL.
+ *
+ * @return The map.
+ */
+channel_map_handle channel_map_ref(const channel_map_handle handle);
+
+/**
+ * Drop a reference to a channel map, the last one deallocates resources.
+ * Safe to call from any thread.
+ *
+ * @param handle_p Pointer to the handle, set to NULL on return.
+ *
+ * @return No return value.
+ */
+void channel_map_cleanup(channel_map_handle *handle_p);
+
+/**
+ * Get the channel of an event.
+ *
+ * @param handle    The compiled map, NULL maps all events to channel 0.
+ * @param lookup    Function used to look up the channel key.
+ * @param user_data User data passed on to the lookup function.
+ * @param source    Return location for the source ID of the channel, an
+ *                  interned string, or NULL to use the SourceID.
+ *
+ * @return The channel number, 1 to MAX_CHANNELS, or 0 if not known.
+ */
+guint channel_map_resolve(const channel_map_handle handle,
+                          content_filter_lookup lookup,
+                          gpointer user_data,
+                          const gchar **source);
+
+#endif // INCLUSION_GUARD_CHANNEL_MAP_H
@@ -0,0 +1,176 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gprintf.h>
+
+#include <syslog.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "debug.h"
+
+/** @file config.c
+ * @Brief Implementation of immutable configuration snapshots.
+ *
+ * The GMainLoop publishes snapshots and hands out references, so a snapshot
+ * can never be freed between loading the current pointer and taking a
+ * reference to it. Labels are interned and not owned by the snapshot.
+ */
+
+/******************** MACRO DEFINITION SECTION ********************************/
+
+
+/******************** LOCAL VARIABLE DECLARATION SECTION **********************/
+
+/**
+ * The current snapshot, created empty on first use.
+ */
+static config *current = NULL;
+
+/******************** LOCAL FUNCTION DECLARATION SECTION **********************/
+
+/**
+ * Free a snapshot, the strings it owns and its references to the compiled
+ * parameters.
+ *
+ * @param cfg The snapshot.
+ *
+ * @return No return value.
+ */
+static void config_free(config *cfg);
+
+/******************** LOCAL FUNCTION DEFINTION SECTION ************************/
+
+/**
+ * Free a snapshot and drop the compiled parameters.
+ */
+static void config_free(config *cfg)
+{
+    g_free(cfg->items);
+    g_free(cfg->filter);
+    g_free(cfg->ipname);
+    g_free(cfg->source);
+    g_free(cfg->username);
+    g_free(cfg->password);
+    g_free(cfg->enabled);
+    g_free(cfg->debug_enabled);
+    g_free(cfg->ingest_socket);
+    g_free(cfg->channel_key);
+    g_free(cfg->channel_sources);
+    item_plan_cleanup(&cfg->item_plan);
+    content_filter_cleanup(&cfg->content_filter);
+    channel_map_cleanup(&cfg->channel_map);
+    g_free(cfg);
+}
+
+/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
+
+/**
+ * Get the current configuration.
+ */
+const config *config_get(void)
+{
+    config *cfg = g_atomic_pointer_get(&current);
+
+    if (cfg == NULL) {
+        cfg = g_new0(config, 1);
+        cfg->ref_count = 1;
+        g_atomic_pointer_set(&current, cfg);
+    }
+
+    return cfg;
+}
+
+/**
+ * Make a writable copy of the current configuration.
+ */
+config *config_edit(void)
+{
+    const config *cfg = config_get();
+    config *copy      = g_new(config, 1);
+
+    *copy = *cfg;
+
+    copy->ref_count       = 1;
+    copy->version         = cfg->version + 1;
+    copy->items           = g_strdup(cfg->items);
+    copy->filter          = g_strdup(cfg->filter);
+    copy->ipname          = g_strdup(cfg->ipname);
+    copy->source          = g_strdup(cfg->source);
+    copy->username        = g_strdup(cfg->username);
+    copy->password        = g_strdup(cfg->password);
+    copy->enabled         = g_strdup(cfg->enabled);
+    copy->debug_enabled   = g_strdup(cfg->debug_enabled);
+    copy->ingest_socket   = g_strdup(cfg->ingest_socket);
+    copy->channel_key     = g_strdup(cfg->channel_key);
+    copy->channel_sources = g_strdup(cfg->channel_sources);
+    copy->item_plan       = item_plan_ref(cfg->item_plan);
+    copy->content_filter  = content_filter_ref(cfg->content_filter);
+    copy->channel_map     = channel_map_ref(cfg->channel_map);
+
+    return copy;
+}
+
+/**
+ * Swap in the edited copy and retire the old snapshot.
+ */
+void config_publish(config *cfg)
+{
+    g_assert(cfg);
+
+    /* Only the GMainLoop publishes, so get and set need no exchange */
+    const config *old = g_atomic_pointer_get(&current);
+
+    g_atomic_pointer_set(&current, cfg);
+
+    DBG_LOG("Published config version %u", cfg->version);
+
+    config_unref(&old);
+}
+
+/**
+ * Take a reference to a snapshot.
+ */
+const config *config_ref(const config *cfg)
+{
+    if (cfg != NULL) {
+        g_atomic_int_inc(&((config *) cfg)->ref_count);
+    }
+
+    return cfg;
+}
+
+/**
+ * Drop a reference to a snapshot, free it if it was the last one.
+ */
+void config_unref(const config **cfg_p)
+{
+    if (cfg_p == NULL) {
+        return;
+    }
+
+    if (*cfg_p == NULL) {
+        return;
+    }
+
+    config *cfg = (config *) *cfg_p;
+
+    *cfg_p = NULL;
+
+    if (g_atomic_int_dec_and_test(&cfg->ref_count)) {
+        config_free(cfg);
+    }
+}
+
+/**
+ * Free the current configuration.
+ */
+void config_cleanup(void)
+{
+    const config *cfg = g_atomic_pointer_get(&current);
+
+    g_atomic_pointer_set(&current, NULL);
+
+    config_unref(&cfg);
+}
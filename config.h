@@ -0,0 +1,113 @@
+#ifndef INCLUSION_GUARD_CONFIG_H
+#define INCLUSION_GUARD_CONFIG_H
+
+#include <glib.h>
+
+#include "item_plan.h"
+#include "content_filter.h"
+#include "channel_map.h"
+
+/** @file config.h
+ * @Brief Immutable, versioned application configuration.
+ *
+ * All parameters are held in a config snapshot that is never changed once
+ * published. A parameter change copies the current snapshot, changes the
+ * copy and publishes it in place of the old one with an atomic swap.
+ *
+ * Snapshots are reference counted. The GMainLoop, which is the only thread
+ * publishing, reads the current snapshot directly and hands references to
+ * the pipeline threads along with each event. The threads read the snapshot
+ * without locks, and a replaced snapshot is freed once the last event
+ * holding it is done.
+ *
+ * The item plan, content filter and channel map compiled from the
+ * parameters are part of the snapshot, so an event is always handled with
+ * the compiled objects matching its config. They are reference counted and
+ * shared by the snapshots until their parameter changes. Only the GMainLoop
+ * runs them, they update their cached key types as they go.
+ */
+
+/**
+ * Configuration snapshot, read only after config_publish().
+ */
+typedef struct config
+{
+    gint        ref_count;
+    guint       version;
+    const gchar *analytic;
+    const gchar *category;
+    gchar       *items;
+    gchar       *filter;
+    gchar       *ipname;
+    gchar       *source;
+    gchar       *username;
+    gchar       *password;
+    gchar       *enabled;
+    gchar       *debug_enabled;
+    gchar       *ingest_socket;
+    gchar       *channel_key;
+    gchar       *channel_sources;
+    guint       encode_workers;
+    guint       max_event_age;
+    gboolean    overlay_enabled;
+    gboolean    overlay_palette;
+    gboolean    overlay_hud;
+    item_plan_handle      item_plan;
+    content_filter_handle content_filter;
+    channel_map_handle    channel_map;
+} config;
+
+/**
+ * Get the current configuration. Only call from the GMainLoop, other
+ * threads must use a reference taken there with config_ref().
+ *
+ * @return The current snapshot, never NULL.
+ */
+const config *config_get(void);
+
+/**
+ * Make a writable copy of the current configuration, with the next version.
+ * Only call from the GMainLoop.
+ *
+ * @return The copy, to be passed on to config_publish().
+ */
+config *config_edit(void);
+
+/**
+ * Replace the current configuration with an edited copy. The old snapshot
+ * is retired and freed when its last reference is dropped.
+ *
+ * @param cfg The copy from config_edit(), owned by the configuration after
+ *            the call.
+ *
+ * @return No return value.
+ */
+void config_publish(config *cfg);
+
+/**
+ * Take a reference to a snapshot. Safe to call from any thread as long as
+ * the caller already holds a reference or is the GMainLoop.
+ *
+ * @param cfg The snapshot.
+ *
+ * @return The snapshot.
+ */
+const config *config_ref(const config *cfg);
+
+/**
+ * Drop a reference to a snapshot. Safe to call from any thread.
+ *
+ * @param cfg_p Pointer to the snapshot, set to NULL on return.
+ *
+ * @return No return value.
+ */
+void config_unref(const config **cfg_p);
+
+/**
+ * Free the current configuration.
+ *
+ * @return No return value.
+ */
+void config_cleanup(void);
+
+#endif // INCLUSION_GUARD_CONFIG_H
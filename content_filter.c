@@ -0,0 +1,886 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gprintf.h>
+
+#include <syslog.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "content_filter.h"
+#include "metadata_pair.h"
+#include "debug.h"
+
+/** @file content_filter.c
+ * @Brief Implementation of compiled content filter expressions.
+ *
+ * The expression is parsed with a recursive descent parser into a linear
+ * program working on a single boolean accumulator. AND and OR compile into
+ * conditional jumps so evaluation short-circuits and keys in untaken
+ * branches are never looked up.
+ */
+
+/******************** MACRO DEFINITION SECTION ********************************/
+
+/**
+ * Max size of a number formatted as text for prefix and regex tests.
+ */
+#define NUMBER_TEXT_SIZE (MDP_FORMAT_SIZE)
+
+/******************** LOCAL VARIABLE DECLARATION SECTION **********************/
+
+typedef enum token_type
+{
+    TOKEN_END = 0,
+    TOKEN_WORD,
+    TOKEN_STRING,
+    TOKEN_COMPARE,
+    TOKEN_AND,
+    TOKEN_OR,
+    TOKEN_NOT,
+    TOKEN_IN,
+    TOKEN_LPAREN,
+    TOKEN_RPAREN,
+    TOKEN_COMMA
+} token_type;
+
+typedef enum test_kind
+{
+    TEST_EQUAL = 0,
+    TEST_NOT_EQUAL,
+    TEST_LESS,
+    TEST_LESS_EQUAL,
+    TEST_GREATER,
+    TEST_GREATER_EQUAL,
+    TEST_PREFIX,
+    TEST_REGEX,
+    TEST_IN
+} test_kind;
+
+typedef enum opcode
+{
+    OP_TEST = 0,
+    OP_NOT,
+    OP_JUMP_IF_FALSE,
+    OP_JUMP_IF_TRUE
+} opcode;
+
+typedef struct token
+{
+    token_type type;
+    test_kind  kind;
+    gchar      *text;
+} token;
+
+/**
+ * Literal operand of a test, pre-parsed for every way it can be compared.
+ */
+typedef struct literal
+{
+    gchar    *string;
+    gboolean is_number;
+    gdouble  number;
+    gboolean is_boolean;
+    gboolean boolean;
+} literal;
+
+typedef struct test
+{
+    test_kind           kind;
+    gchar               *key;
+    content_filter_type type_hint;
+    literal             *literals;
+    guint               n_literals;
+    GRegex              *regex;
+} test;
+
+typedef struct instruction
+{
+    opcode op;
+    guint  arg;
+} instruction;
+
+typedef struct content_filter
+{
+    gint        ref_count;
+    instruction *program;
+    guint       n_instructions;
+    test        *tests;
+    guint       n_tests;
+    gboolean    reject_all;
+} content_filter;
+
+/**
+ * Parser state used while compiling.
+ */
+typedef struct parser
+{
+    GArray *tokens;
+    guint  pos;
+    GArray *program;
+    GArray *tests;
+    gchar  *error;
+} parser;
+
+/******************** LOCAL FUNCTION DECLARATION SECTION **********************/
+
+/**
+ * Split expression into tokens.
+ *
+ * @param expression The filter expression.
+ * @param tokens     Array of token to append to.
+ * @param error      Location to place error message.
+ *
+ * @return TRUE on success, FALSE on syntax error.
+ */
+static gboolean tokenize(const char *expression, GArray *tokens,
+                         gchar **error);
+
+/**
+ * Parse an OR expression, the top level of the grammar.
+ *
+ * @param p Parser state.
+ *
+ * @return TRUE on success, FALSE on syntax error.
+ */
+static gboolean parse_or(parser *p);
+
+/**
+ * Parse an AND expression.
+ *
+ * @param p Parser state.
+ *
+ * @return TRUE on success, FALSE on syntax error.
+ */
+static gboolean parse_and(parser *p);
+
+/**
+ * Parse NOT, parenthesis or a single comparison.
+ *
+ * @param p Parser state.
+ *
+ * @return TRUE on success, FALSE on syntax error.
+ */
+static gboolean parse_unary(parser *p);
+
+/**
+ * Parse a comparison and emit a test instruction for it.
+ *
+ * @param p Parser state.
+ *
+ * @return TRUE on success, FALSE on syntax error.
+ */
+static gboolean parse_comparison(parser *p);
+
+/**
+ * Run a single test against the looked up value.
+ *
+ * @param t     The test.
+ * @param value The looked up value.
+ *
+ * @return Result of the test.
+ */
+static gboolean run_test(const test *t, const content_filter_value *value);
+
+/******************** LOCAL FUNCTION DEFINTION SECTION ************************/
+
+static gboolean is_word_char(char c)
+{
+    return c != '\0' && !g_ascii_isspace(c) && strchr("()!,\"'=<>^~&|", c)
+        == NULL;
+}
+
+/**
+ * Split expression into tokens.
+ */
+static gboolean tokenize(const char *expression, GArray *tokens,
+                         gchar **error)
+{
+    const char *c = expression;
+
+    while (*c != '\0') {
+        token t = { TOKEN_END, TEST_EQUAL, NULL };
+
+        if (g_ascii_isspace(*c)) {
+            c++;
+            continue;
+        }
+
+        if (*c == '(') {
+            t.type = TOKEN_LPAREN;
+            c++;
+        } else if (*c == ')') {
+            t.type = TOKEN_RPAREN;
+            c++;
+        } else if (*c == ',') {
+            t.type = TOKEN_COMMA;
+            c++;
+        } else if (c[0] == '&' && c[1] == '&') {
+            t.type = TOKEN_AND;
+            c += 2;
+        } else if (c[0] == '|' && c[1] == '|') {
+            t.type = TOKEN_OR;
+            c += 2;
+        } else if (c[0] == '!' && c[1] == '=') {
+            t.type = TOKEN_COMPARE;
+            t.kind = TEST_NOT_EQUAL;
+            c += 2;
+        } else if (*c == '!') {
+            t.type = TOKEN_NOT;
+            c++;
+        } else if (*c == '=') {
+            t.type = TOKEN_COMPARE;
+            t.kind = TEST_EQUAL;
+            c += (c[1] == '=') ? 2 : 1;
+        } else if (*c == '<' || *c == '>') {
+            gboolean less = (*c == '<');
+            t.type = TOKEN_COMPARE;
+
+            if (c[1] == '=') {
+                t.kind = less ? TEST_LESS_EQUAL : TEST_GREATER_EQUAL;
+                c += 2;
+            } else {
+                t.kind = less ? TEST_LESS : TEST_GREATER;
+                c++;
+            }
+        } else if ((c[0] == '^' || c[0] == '~') && c[1] == '=') {
+            t.type = TOKEN_COMPARE;
+            t.kind = (c[0] == '^') ? TEST_PREFIX : TEST_REGEX;
+            c += 2;
+        } else if (*c == '"' || *c == '\'') {
+            const char *end = strchr(c + 1, *c);
+
+            if (end == NULL) {
+                *error = g_strdup("Unterminated quote");
+                return FALSE;
+            }
+
+            t.type = TOKEN_STRING;
+            t.text = g_strndup(c + 1, end - c - 1);
+            c = end + 1;
+        } else if (is_word_char(*c)) {
+            const char *start = c;
+
+            while (is_word_char(*c)) {
+                c++;
+            }
+
+            t.type = TOKEN_WORD;
+            t.text = g_strndup(start, c - start);
+
+            if (g_ascii_strcasecmp(t.text, "AND") == 0) {
+                t.type = TOKEN_AND;
+            } else if (g_ascii_strcasecmp(t.text, "OR") == 0) {
+                t.type = TOKEN_OR;
+            } else if (g_ascii_strcasecmp(t.text, "NOT") == 0) {
+                t.type = TOKEN_NOT;
+            } else if (g_ascii_strcasecmp(t.text, "IN") == 0) {
+                t.type = TOKEN_IN;
+                t.kind = TEST_IN;
+            }
+        } else {
+            *error = g_strdup_printf("Unexpected character '%c'", *c);
+            return FALSE;
+        }
+
+        g_array_append_val(tokens, t);
+    }
+
+    return TRUE;
+}
+
+static const token *peek(const parser *p)
+{
+    return &g_array_index(p->tokens, token, p->pos);
+}
+
+static guint emit(parser *p, opcode op, guint arg)
+{
+    instruction ins = { op, arg };
+
+    g_array_append_val(p->program, ins);
+
+    return p->program->len - 1;
+}
+
+/**
+ * Point all jumps in the list at the current end of the program.
+ */
+static void patch_jumps(parser *p, GArray *jumps)
+{
+    guint i = 0;
+    for (; i < jumps->len; i++) {
+        g_array_index(p->program, instruction,
+            g_array_index(jumps, guint, i)).arg = p->program->len;
+    }
+}
+
+/**
+ * Parse an OR expression, a OR b compiles to a; JUMP_IF_TRUE end; b.
+ */
+static gboolean parse_or(parser *p)
+{
+    GArray *jumps = g_array_new(FALSE, FALSE, sizeof(guint));
+    gboolean ret  = parse_and(p);
+
+    while (ret && peek(p)->type == TOKEN_OR) {
+        p->pos++;
+
+        guint jump = emit(p, OP_JUMP_IF_TRUE, 0);
+        g_array_append_val(jumps, jump);
+
+        ret = parse_and(p);
+    }
+
+    patch_jumps(p, jumps);
+    g_array_free(jumps, TRUE);
+
+    return ret;
+}
+
+/**
+ * Parse an AND expression, a AND b compiles to a; JUMP_IF_FALSE end; b.
+ */
+static gboolean parse_and(parser *p)
+{
+    GArray *jumps = g_array_new(FALSE, FALSE, sizeof(guint));
+    gboolean ret  = parse_unary(p);
+
+    while (ret && peek(p)->type == TOKEN_AND) {
+        p->pos++;
+
+        guint jump = emit(p, OP_JUMP_IF_FALSE, 0);
+        g_array_append_val(jumps, jump);
+
+        ret = parse_unary(p);
+    }
+
+    patch_jumps(p, jumps);
+    g_array_free(jumps, TRUE);
+
+    return ret;
+}
+
+/**
+ * Parse NOT, parenthesis or a single comparison.
+ */
+static gboolean parse_unary(parser *p)
+{
+    const token *t = peek(p);
+
+    if (t->type == TOKEN_NOT) {
+        p->pos++;
+
+        if (!parse_unary(p)) {
+            return FALSE;
+        }
+
+        emit(p, OP_NOT, 0);
+        return TRUE;
+    }
+
+    if (t->type == TOKEN_LPAREN) {
+        p->pos++;
+
+        if (!parse_or(p)) {
+            return FALSE;
+        }
+
+        if (peek(p)->type != TOKEN_RPAREN) {
+            p->error = g_strdup("Missing )");
+            return FALSE;
+        }
+
+        p->pos++;
+        return TRUE;
+    }
+
+    return parse_comparison(p);
+}
+
+static void parse_literal(literal *l, const gchar *text)
+{
+    gchar *end = NULL;
+
+    l->string = g_strdup(text);
+    l->number = g_ascii_strtod(text, &end);
+    l->is_number = (end != text && *end == '\0');
+
+    if (g_ascii_strcasecmp(text, "yes") == 0 ||
+        g_ascii_strcasecmp(text, "true") == 0) {
+        l->is_boolean = TRUE;
+        l->boolean    = TRUE;
+    } else if (g_ascii_strcasecmp(text, "no") == 0 ||
+               g_ascii_strcasecmp(text, "false") == 0) {
+        l->is_boolean = TRUE;
+        l->boolean    = FALSE;
+    }
+}
+
+static gboolean is_operand(const token *t)
+{
+    return t->type == TOKEN_WORD || t->type == TOKEN_STRING;
+}
+
+/**
+ * Parse a comparison on the form key OP value or key IN (v1, v2, ...).
+ */
+static gboolean parse_comparison(parser *p)
+{
+    const token *key = peek(p);
+
+    if (key->type != TOKEN_WORD) {
+        p->error = g_strdup("Expected key");
+        return FALSE;
+    }
+
+    p->pos++;
+
+    const token *op = peek(p);
+
+    if (op->type != TOKEN_COMPARE && op->type != TOKEN_IN) {
+        p->error = g_strdup_printf("Expected operator after %s", key->text);
+        return FALSE;
+    }
+
+    p->pos++;
+
+    GPtrArray *operands = g_ptr_array_new();
+    gboolean ret        = TRUE;
+
+    if (op->type == TOKEN_IN) {
+        if (peek(p)->type != TOKEN_LPAREN) {
+            p->error = g_strdup("Expected ( after IN");
+            ret = FALSE;
+        } else {
+            p->pos++;
+
+            while (ret) {
+                if (!is_operand(peek(p))) {
+                    p->error = g_strdup("Expected value in IN list");
+                    ret = FALSE;
+                    break;
+                }
+
+                g_ptr_array_add(operands, peek(p)->text);
+                p->pos++;
+
+                if (peek(p)->type == TOKEN_RPAREN) {
+                    p->pos++;
+                    break;
+                } else if (peek(p)->type != TOKEN_COMMA) {
+                    p->error = g_strdup("Expected , or ) in IN list");
+                    ret = FALSE;
+                } else {
+                    p->pos++;
+                }
+            }
+        }
+    } else if (is_operand(peek(p))) {
+        g_ptr_array_add(operands, peek(p)->text);
+        p->pos++;
+    } else {
+        p->error = g_strdup_printf("Expected value after %s", key->text);
+        ret = FALSE;
+    }
+
+    if (ret) {
+        test t;
+        memset(&t, 0, sizeof(t));
+
+        t.kind       = op->kind;
+        t.key        = g_strdup(key->text);
+        t.n_literals = operands->len;
+        t.literals   = g_new0(literal, operands->len);
+
+        guint i = 0;
+        for (; i < operands->len; i++) {
+            parse_literal(&t.literals[i], g_ptr_array_index(operands, i));
+        }
+
+        if (t.kind == TEST_REGEX) {
+            GError *regex_error = NULL;
+
+            t.regex = g_regex_new(t.literals[0].string, G_REGEX_OPTIMIZE, 0,
+                &regex_error);
+
+            if (regex_error != NULL) {
+                p->error = g_strdup(regex_error->message);
+                g_error_free(regex_error);
+                ret = FALSE;
+            }
+        }
+
+        if ((t.kind == TEST_LESS || t.kind == TEST_LESS_EQUAL ||
+             t.kind == TEST_GREATER || t.kind == TEST_GREATER_EQUAL) &&
+            !t.literals[0].is_number) {
+            p->error = g_strdup_printf("%s is not a number",
+                t.literals[0].string);
+            ret = FALSE;
+        }
+
+        /* Added even on error so cleanup frees it */
+        g_array_append_val(p->tests, t);
+        emit(p, OP_TEST, p->tests->len - 1);
+    }
+
+    g_ptr_array_free(operands, TRUE);
+
+    return ret;
+}
+
+static gboolean value_as_number(const content_filter_value *value,
+                                gdouble *number)
+{
+    gchar *end = NULL;
+
+    switch (value->type) {
+    case CONTENT_FILTER_TYPE_INTEGER:
+        *number = value->integer;
+        return TRUE;
+    case CONTENT_FILTER_TYPE_DOUBLE:
+        *number = value->number;
+        return TRUE;
+    case CONTENT_FILTER_TYPE_STRING:
+        *number = g_ascii_strtod(value->string, &end);
+        return end != value->string && *end == '\0';
+    default:
+        return FALSE;
+    }
+}
+
+/**
+ * Get value as text the same way it is presented as a metadata item.
+ */
+static const gchar *value_as_text(const content_filter_value *value,
+                                  gchar *buffer)
+{
+    switch (value->type) {
+    case CONTENT_FILTER_TYPE_STRING:
+        return value->string;
+    case CONTENT_FILTER_TYPE_BOOLEAN:
+        return value->boolean ? "yes" : "no";
+    case CONTENT_FILTER_TYPE_INTEGER:
+        g_snprintf(buffer, NUMBER_TEXT_SIZE, "%d", value->integer);
+        return buffer;
+    case CONTENT_FILTER_TYPE_DOUBLE:
+        return mdp_format_double(value->number, buffer);
+    default:
+        return "";
+    }
+}
+
+static gboolean literal_equal(const literal *l,
+                              const content_filter_value *value)
+{
+    gdouble number;
+
+    switch (value->type) {
+    case CONTENT_FILTER_TYPE_STRING:
+        return g_strcmp0(l->string, value->string) == 0 ||
+            (l->is_number && value_as_number(value, &number) &&
+             l->number == number);
+    case CONTENT_FILTER_TYPE_BOOLEAN:
+        return l->is_boolean && l->boolean == value->boolean;
+    case CONTENT_FILTER_TYPE_INTEGER:
+    case CONTENT_FILTER_TYPE_DOUBLE:
+        return l->is_number && value_as_number(value, &number) &&
+            l->number == number;
+    default:
+        return FALSE;
+    }
+}
+
+/**
+ * Run a single test against the looked up value.
+ */
+static gboolean run_test(const test *t, const content_filter_value *value)
+{
+    gchar buffer[NUMBER_TEXT_SIZE];
+    gdouble number;
+    guint i;
+
+    switch (t->kind) {
+    case TEST_EQUAL:
+        return literal_equal(&t->literals[0], value);
+    case TEST_NOT_EQUAL:
+        return !literal_equal(&t->literals[0], value);
+    case TEST_IN:
+        for (i = 0; i < t->n_literals; i++) {
+            if (literal_equal(&t->literals[i], value)) {
+                return TRUE;
+            }
+        }
+        return FALSE;
+    case TEST_LESS:
+        return value_as_number(value, &number) &&
+            number < t->literals[0].number;
+    case TEST_LESS_EQUAL:
+        return value_as_number(value, &number) &&
+            number <= t->literals[0].number;
+    case TEST_GREATER:
+        return value_as_number(value, &number) &&
+            number > t->literals[0].number;
+    case TEST_GREATER_EQUAL:
+        return value_as_number(value, &number) &&
+            number >= t->literals[0].number;
+    case TEST_PREFIX:
+        return g_str_has_prefix(value_as_text(value, buffer),
+            t->literals[0].string);
+    case TEST_REGEX:
+        return g_regex_match(t->regex, value_as_text(value, buffer), 0,
+            NULL);
+    default:
+        return FALSE;
+    }
+}
+
+static void free_tests(test *tests, guint n_tests)
+{
+    guint i = 0;
+    for (; i < n_tests; i++) {
+        guint j = 0;
+        for (; j < tests[i].n_literals; j++) {
+            g_free(tests[i].literals[j].string);
+        }
+
+        g_free(tests[i].literals);
+        g_free(tests[i].key);
+
+        if (tests[i].regex) {
+            g_regex_unref(tests[i].regex);
+        }
+    }
+
+    g_free(tests);
+}
+
+/**
+ * Build the plain key=value filter used by earlier versions, where the
+ * value is taken verbatim. Used when the expression does not parse, so
+ * filters like name=A&B or name=Tom and Jerry keep working after an
+ * upgrade.
+ */
+static gboolean compile_legacy(content_filter *filter, const char *expression)
+{
+    gchar **filter_items = g_strsplit(expression, "=", 2);
+    gboolean ret         = FALSE;
+
+    const gchar *key     = filter_items[0];
+
+    while (key != NULL && is_word_char(*key)) {
+        key++;
+    }
+
+    /* Only a single plain key, everything after the first = is the value */
+    if (key != NULL && *key == '\0' && key != filter_items[0] &&
+        filter_items[1] != NULL) {
+        filter->tests          = g_new0(test, 1);
+        filter->n_tests        = 1;
+        filter->tests[0].kind  = TEST_EQUAL;
+        filter->tests[0].key   = g_strdup(filter_items[0]);
+        filter->tests[0].n_literals = 1;
+        filter->tests[0].literals   = g_new0(literal, 1);
+        parse_literal(&filter->tests[0].literals[0], filter_items[1]);
+
+        filter->program        = g_new0(instruction, 1);
+        filter->n_instructions = 1;
+        ret = TRUE;
+    }
+
+    g_strfreev(filter_items);
+
+    return ret;
+}
+
+/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
+
+/**
+ * Free the string of a value, borrowed strings belong to the lookup.
+ */
+void content_filter_value_clear(content_filter_value *value)
+{
+    if (!value->borrowed) {
+        g_free(value->string);
+    }
+
+    value->string = NULL;
+}
+
+/**
+ * Compile content filter expression.
+ */
+content_filter_handle content_filter_init(const char *expression,
+                                          char **error)
+{
+    g_assert(error);
+
+    if (expression == NULL) {
+        return NULL;
+    }
+
+    gchar *stripped = g_strstrip(g_strdup(expression));
+
+    if (*stripped == '\0') {
+        g_free(stripped);
+        return NULL;
+    }
+
+    content_filter_handle handle = g_new0(content_filter, 1);
+    handle->ref_count            = 1;
+
+    parser p;
+    p.tokens  = g_array_new(FALSE, FALSE, sizeof(token));
+    p.pos     = 0;
+    p.program = g_array_new(FALSE, FALSE, sizeof(instruction));
+    p.tests   = g_array_new(FALSE, TRUE, sizeof(test));
+    p.error   = NULL;
+
+    gboolean ret = tokenize(stripped, p.tokens, &p.error);
+
+    /* Terminating token so the parser never reads out of bounds */
+    token end = { TOKEN_END, TEST_EQUAL, NULL };
+    g_array_append_val(p.tokens, end);
+
+    if (ret) {
+        ret = parse_or(&p);
+    }
+
+    if (ret && peek(&p)->type != TOKEN_END) {
+        p.error = g_strdup("Unexpected trailing input");
+        ret = FALSE;
+    }
+
+    handle->n_tests        = p.tests->len;
+    handle->tests          = (test *) g_array_free(p.tests, FALSE);
+    handle->n_instructions = p.program->len;
+    handle->program        = (instruction *) g_array_free(p.program, FALSE);
+
+    guint i = 0;
+    for (; i < p.tokens->len; i++) {
+        g_free(g_array_index(p.tokens, token, i).text);
+    }
+    g_array_free(p.tokens, TRUE);
+
+    if (!ret) {
+        free_tests(handle->tests, handle->n_tests);
+        g_free(handle->program);
+        handle->tests          = NULL;
+        handle->n_tests        = 0;
+        handle->program        = NULL;
+        handle->n_instructions = 0;
+
+        if (compile_legacy(handle, stripped)) {
+            LOG("Content filter is not an expression (%s), matching the "
+                "value verbatim", p.error);
+        } else {
+            *error = p.error;
+            p.error = NULL;
+            handle->reject_all = TRUE;
+        }
+    }
+
+    g_free(p.error);
+    g_free(stripped);
+
+    return handle;
+}
+
+/**
+ * Take a reference to a content filter.
+ */
+content_filter_handle content_filter_ref(const content_filter_handle handle)
+{
+    if (handle != NULL) {
+        g_atomic_int_inc(&handle->ref_count);
+    }
+
+    return handle;
+}
+
+/**
+ * Drop a reference, cleanup content filter with the last one.
+ */
+void content_filter_cleanup(content_filter_handle *handle_p)
+{
+    if (handle_p == NULL) {
+        return;
+    }
+
+    if (*handle_p == NULL) {
+        return;
+    }
+
+    content_filter_handle handle = *handle_p;
+
+    *handle_p = NULL;
+
+    if (!g_atomic_int_dec_and_test(&handle->ref_count)) {
+        return;
+    }
+
+    free_tests(handle->tests, handle->n_tests);
+    g_free(handle->program);
+    g_free(handle);
+}
+
+/**
+ * Run content filter program.
+ */
+gboolean content_filter_match(const content_filter_handle handle,
+                              content_filter_lookup lookup,
+                              gpointer user_data)
+{
+    g_assert(lookup);
+
+    if (handle == NULL) {
+        return TRUE;
+    }
+
+    if (handle->reject_all) {
+        return FALSE;
+    }
+
+    gboolean acc = FALSE;
+    guint pc     = 0;
+
+    while (pc < handle->n_instructions) {
+        const instruction *ins = &handle->program[pc++];
+
+        switch (ins->op) {
+        case OP_TEST: {
+            test *t = &handle->tests[ins->arg];
+            content_filter_value value;
+
+            memset(&value, 0, sizeof(value));
+            value.type = t->type_hint;
+
+            /* A missing key fails the test */
+            acc = lookup(t->key, &value, user_data);
+
+            if (acc) {
+                t->type_hint = value.type;
+                acc = run_test(t, &value);
+            }
+
+            content_filter_value_clear(&value);
+            break;
+        }
+        case OP_NOT:
+            acc = !acc;
+            break;
+        case OP_JUMP_IF_FALSE:
+            if (!acc) {
+                pc = ins->arg;
+            }
+            break;
+        case OP_JUMP_IF_TRUE:
+            if (acc) {
+                pc = ins->arg;
+            }
+            break;
+        }
+    }
+
+    return acc;
+}
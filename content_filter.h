@@ -0,0 +1,128 @@
+#ifndef INCLUSION_GUARD_CONTENT_FILTER_H
+#define INCLUSION_GUARD_CONTENT_FILTER_H
+
+#include <glib.h>
+
+/** @file content_filter.h
+ * @Brief Compiled content filter expressions.
+ *
+ * The ContentFilter parameter is compiled once into a small program that is
+ * run against each event before any metadata items are extracted.
+ *
+ * Syntax, keywords are case insensitive:
+ *
+ * - key=value, key!=value   Equality, numeric if both sides are numbers.
+ * - key<5, <=, >, >=        Numeric comparison.
+ * - key^=prefix             Value starts with prefix.
+ * - key~=regex              Value matches regular expression.
+ * - key IN (a, b, c)        Value equals any of the listed values.
+ * - AND, OR, NOT, ( )       Also written as &&, || and !.
+ *
+ * Values containing spaces or operator characters can be quoted with
+ * single or double quotes. A filter that is not a valid expression but a
+ * single key=value, as used by earlier versions, matches the text after the
+ * first = verbatim.
+ */
+
+/**
+ * Forward-declared handle for content filter object.
+ */
+typedef struct content_filter* content_filter_handle;
+
+/**
+ * Value types a looked up filter value can have.
+ */
+typedef enum content_filter_type
+{
+    CONTENT_FILTER_TYPE_UNKNOWN = 0,
+    CONTENT_FILTER_TYPE_STRING,
+    CONTENT_FILTER_TYPE_BOOLEAN,
+    CONTENT_FILTER_TYPE_INTEGER,
+    CONTENT_FILTER_TYPE_DOUBLE
+} content_filter_type;
+
+/**
+ * Value of a key as returned by the lookup function.
+ */
+typedef struct content_filter_value
+{
+    content_filter_type type;
+    gchar    *string;
+    gboolean borrowed;
+    gboolean boolean;
+    gint     integer;
+    gdouble  number;
+} content_filter_value;
+
+/**
+ * Function used by the filter to look up the value of a key.
+ *
+ * @param key       Name of the key to look up.
+ * @param value     On entry type holds the type the key had the last time
+ *                  it was found, try that first. On success fill in type and
+ *                  the matching field. A string is freed by the caller with
+ *                  content_filter_value_clear(), unless borrowed is set
+ *                  because it stays valid as long as the user data.
+ * @param user_data User data passed to content_filter_match().
+ *
+ * @return TRUE if the key was found, FALSE otherwise.
+ */
+typedef gboolean (*content_filter_lookup)(const char *key,
+                                          content_filter_value *value,
+                                          gpointer user_data);
+
+/**
+ * Free the string of a looked up value unless it is borrowed.
+ *
+ * @param value The value.
+ *
+ * @return No return value.
+ */
+void content_filter_value_clear(content_filter_value *value);
+
+/**
+ * Compile a content filter expression.
+ *
+ * @param expression The filter expression, " " or empty for no filter.
+ * @param error      Mandatory location to place error message on failure.
+ *                   A filter that fails to compile, and is not a plain
+ *                   key=value either, rejects all events.
+ *
+ * @return Handle for the compiled filter, NULL if there is no filter.
+ */
+content_filter_handle content_filter_init(const char *expression,
+                                          char **error);
+
+/**
+ * Take a reference to a compiled filter. Safe to call from any thread.
+ *
+ * @param handle The filter, may be NULL.
+ *
+ * @return The filter.
+ */
+content_filter_handle content_filter_ref(const content_filter_handle handle);
+
+/**
+ * Drop a reference to a content filter, the last one deallocates
+ * resources. Safe to call from any thread.
+ *
+ * @param handle_p Pointer to the handle, set to NULL on return.
+ *
+ * @return No return value.
+ */
+void content_filter_cleanup(content_filter_handle *handle_p);
+
+/**
+ * Run the filter against an event.
+ *
+ * @param handle    The compiled filter, NULL matches everything.
+ * @param lookup    Function used to look up key values.
+ * @param user_data User data passed on to the lookup function.
+ *
+ * @return TRUE if the event passes the filter, FALSE if it is rejected.
+ */
+gboolean content_filter_match(const content_filter_handle handle,
+                              content_filter_lookup lookup,
+                              gpointer user_data);
+
+#endif // INCLUSION_GUARD_CONTENT_FILTER_H
@@ -0,0 +1,277 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gprintf.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "hud.h"
+#include "metadata_pair.h"
+#include "debug.h"
+
+/** @file hud.c
+ * @Brief Implementation of the performance counters.
+ *
+ * Send latencies are written to a fixed ring of samples with one atomic
+ * increment claiming the slot, the sender never waits for the HUD. The
+ * sampler copies the slots written since the previous sample and sorts
+ * them for the percentiles. A burst of more sends than fit in the ring only
+ * keeps the latest ones, and a slot being rewritten while it is copied may
+ * give a newer value, both fine for a diagnostic view.
+ */
+
+/******************** MACRO DEFINITION SECTION ********************************/
+
+/**
+ * Number of latency samples kept between two HUD samples, a power of two.
+ */
+#define LATENCY_SAMPLES (256)
+
+/**
+ * Index of the items in a HUD sample.
+ */
+typedef enum hud_item
+{
+    HUD_EVENT_RATE = 0,
+    HUD_QUEUE_DEPTH,
+    HUD_SEND_P50,
+    HUD_SEND_P90,
+    HUD_SEND_P99,
+    HUD_DROPPED_FULL,
+    HUD_DROPPED_STALE,
+    HUD_LOOP_LAG,
+    NBR_OF_HUD_ITEMS
+} hud_item;
+
+/******************** LOCAL VARIABLE DECLARATION SECTION **********************/
+
+/**
+ * Names of the HUD items, interned in hud_init().
+ */
+static const gchar *item_names[NBR_OF_HUD_ITEMS] = {
+    [HUD_EVENT_RATE]    = "Events/s",
+    [HUD_QUEUE_DEPTH]   = "Queue depth",
+    [HUD_SEND_P50]      = "Send p50 ms",
+    [HUD_SEND_P90]      = "Send p90 ms",
+    [HUD_SEND_P99]      = "Send p99 ms",
+    [HUD_DROPPED_FULL]  = "Dropped full",
+    [HUD_DROPPED_STALE] = "Dropped stale",
+    [HUD_LOOP_LAG]      = "Loop lag ms",
+};
+
+typedef struct hud
+{
+    /* Written from the pipeline threads */
+    volatile gint next_latency;
+    volatile gint latencies[LATENCY_SAMPLES];
+
+    /* GMainLoop only */
+    guint        interval;
+    guint        events;
+    guint        sampled_events;
+    guint        sampled_latency;
+    gint64       sampled_time;
+    const gchar  *names[NBR_OF_HUD_ITEMS];
+    gint         sorted[LATENCY_SAMPLES];
+} hud;
+
+/******************** LOCAL FUNCTION DECLARATION SECTION **********************/
+
+/**
+ * Compare two latency samples for qsort().
+ *
+ * @param a First sample.
+ * @param b Second sample.
+ *
+ * @return Negative, zero or positive as a is less, equal or greater than b.
+ */
+static int compare_latency(const void *a, const void *b);
+
+/**
+ * Set a latency percentile item, "-" if nothing was sent.
+ *
+ * @param record_p   Pointer to the sample record.
+ * @param index      Index of the item.
+ * @param name       Name of the item.
+ * @param sorted     Sorted latency samples in us.
+ * @param n_sorted   Number of samples.
+ * @param percentile The percentile, 1 to 100.
+ *
+ * @return No return value.
+ */
+static void set_percentile(mdp_record **record_p,
+                           guint index,
+                           const gchar *name,
+                           const gint *sorted,
+                           guint n_sorted,
+                           guint percentile);
+
+/******************** LOCAL FUNCTION DEFINTION SECTION ************************/
+
+/**
+ * Compare two latency samples.
+ */
+static int compare_latency(const void *a, const void *b)
+{
+    gint first  = *(const gint *) a;
+    gint second = *(const gint *) b;
+
+    return (first > second) - (first < second);
+}
+
+/**
+ * Set a nearest rank percentile, in ms with one decimal.
+ */
+static void set_percentile(mdp_record **record_p,
+                           guint index,
+                           const gchar *name,
+                           const gint *sorted,
+                           guint n_sorted,
+                           guint percentile)
+{
+    if (n_sorted == 0) {
+        mdp_record_set_string(record_p, index, name, "-");
+        return;
+    }
+
+    guint rank = (n_sorted * percentile + 99) / 100;
+
+    mdp_record_set_double(*record_p, index, name,
+        (gint) (sorted[rank - 1] / 100) / 10.0);
+}
+
+/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
+
+/**
+ * Create the HUD counters.
+ */
+hud_handle hud_init(guint interval)
+{
+    hud_handle handle = g_new0(hud, 1);
+
+    handle->interval = interval;
+
+    guint i = 0;
+    for (; i < NBR_OF_HUD_ITEMS; i++) {
+        handle->names[i] = g_intern_static_string(item_names[i]);
+    }
+
+    hud_reset(handle);
+
+    return handle;
+}
+
+/**
+ * Cleanup HUD.
+ */
+void hud_cleanup(hud_handle *handle_p)
+{
+    if (handle_p == NULL) {
+        return;
+    }
+
+    if (*handle_p == NULL) {
+        return;
+    }
+
+    g_free(*handle_p);
+
+    *handle_p = NULL;
+}
+
+/**
+ * Count one event.
+ */
+void hud_count_event(const hud_handle handle)
+{
+    if (handle == NULL) {
+        return;
+    }
+
+    handle->events++;
+}
+
+/**
+ * Claim the next slot of the ring and store the latency in it.
+ */
+void hud_add_latency(const hud_handle handle, gint64 latency)
+{
+    if (handle == NULL) {
+        return;
+    }
+
+    guint slot = (guint) g_atomic_int_add(&handle->next_latency, 1);
+
+    g_atomic_int_set(&handle->latencies[slot & (LATENCY_SAMPLES - 1)],
+        (gint) CLAMP(latency, 0, G_MAXINT));
+}
+
+/**
+ * Restart the rates and percentiles from now.
+ */
+void hud_reset(const hud_handle handle)
+{
+    handle->sampled_events  = handle->events;
+    handle->sampled_latency = (guint) g_atomic_int_get(&handle->next_latency);
+    handle->sampled_time    = g_get_monotonic_time();
+}
+
+/**
+ * Take a sample of the counters.
+ */
+mdp_record *hud_sample(const hud_handle handle,
+                       guint queue_depth,
+                       guint dropped_full,
+                       guint dropped_stale)
+{
+    gint64 now     = g_get_monotonic_time();
+    gint64 elapsed = MAX(now - handle->sampled_time, 1);
+
+    /* The timer is due one interval after the previous dispatch */
+    gint64 lag = MAX(elapsed - (gint64) handle->interval * 1000, 0);
+
+    gdouble rate = (handle->events - handle->sampled_events) *
+        (gdouble) G_USEC_PER_SEC / elapsed;
+
+    /* Only the latest samples are left if the ring wrapped */
+    guint next     = (guint) g_atomic_int_get(&handle->next_latency);
+    guint n_sorted = MIN(next - handle->sampled_latency, LATENCY_SAMPLES);
+
+    guint i = 0;
+    for (; i < n_sorted; i++) {
+        guint slot = (next - n_sorted + i) & (LATENCY_SAMPLES - 1);
+        handle->sorted[i] = g_atomic_int_get(&handle->latencies[slot]);
+    }
+
+    qsort(handle->sorted, n_sorted, sizeof(gint), compare_latency);
+
+    handle->sampled_events  = handle->events;
+    handle->sampled_latency = next;
+    handle->sampled_time    = now;
+
+    mdp_record *record = mdp_record_new(NBR_OF_HUD_ITEMS);
+
+    mdp_record_set_double(record, HUD_EVENT_RATE,
+        handle->names[HUD_EVENT_RATE], (gint64) (rate * 10 + 0.5) / 10.0);
+    mdp_record_set_integer(record, HUD_QUEUE_DEPTH,
+        handle->names[HUD_QUEUE_DEPTH], queue_depth);
+    mdp_record_set_integer(record, HUD_DROPPED_FULL,
+        handle->names[HUD_DROPPED_FULL], dropped_full);
+    mdp_record_set_integer(record, HUD_DROPPED_STALE,
+        handle->names[HUD_DROPPED_STALE], dropped_stale);
+    mdp_record_set_integer(record, HUD_LOOP_LAG,
+        handle->names[HUD_LOOP_LAG], lag / 1000);
+
+    set_percentile(&record, HUD_SEND_P50, handle->names[HUD_SEND_P50],
+        handle->sorted, n_sorted, 50);
+    set_percentile(&record, HUD_SEND_P90, handle->names[HUD_SEND_P90],
+        handle->sorted, n_sorted, 90);
+    set_percentile(&record, HUD_SEND_P99, handle->names[HUD_SEND_P99],
+        handle->sorted, n_sorted, 99);
+
+    DBG_LOG("HUD %.1f events/s, %u queued, %u latency samples", rate,
+        queue_depth, n_sorted);
+
+    return record;
+}
@@ -0,0 +1,88 @@
+#ifndef INCLUSION_GUARD_HUD_H
+#define INCLUSION_GUARD_HUD_H
+
+#include <glib.h>
+
+#include "metadata_pair.h"
+
+/** @file hud.h
+ * @Brief Performance counters for the diagnostics overlay.
+ *
+ * The hot paths only bump counters, an event count in the GMainLoop and a
+ * send latency sample from the pipeline. Everything else, rates,
+ * percentiles and the main loop lag, is worked out when a sample is taken
+ * at the low fixed HUD rate. The sample is a metadata record so it is shown
+ * by the regular overlay.
+ */
+
+/**
+ * Forward-declared handle for HUD object.
+ */
+typedef struct hud* hud_handle;
+
+/**
+ * Create the HUD counters.
+ *
+ * @param interval Time in ms between two samples, used to measure how late
+ *                 the GMainLoop dispatches the sample timer.
+ *
+ * @return Handle for the counters.
+ */
+hud_handle hud_init(guint interval);
+
+/**
+ * Cleanup HUD and deallocate resources.
+ *
+ * @param handle_p Pointer to the handle, set to NULL on return.
+ *
+ * @return No return value.
+ */
+void hud_cleanup(hud_handle *handle_p);
+
+/**
+ * Count one event handed to the pipeline. Only call from the GMainLoop.
+ *
+ * @param handle The HUD, ignored if NULL.
+ *
+ * @return No return value.
+ */
+void hud_count_event(const hud_handle handle);
+
+/**
+ * Add a send latency sample, may be called from any thread.
+ *
+ * @param handle  The HUD, ignored if NULL.
+ * @param latency Time in us from the event to handing its command to ACS.
+ *
+ * @return No return value.
+ */
+void hud_add_latency(const hud_handle handle, gint64 latency);
+
+/**
+ * Restart the rates and percentiles, e.g. when the HUD is switched on.
+ * Only call from the GMainLoop.
+ *
+ * @param handle The HUD.
+ *
+ * @return No return value.
+ */
+void hud_reset(const hud_handle handle);
+
+/**
+ * Take a sample of the counters since the previous one. Only call from the
+ * GMainLoop, from a timer running at the interval given to hud_init().
+ *
+ * @param handle        The HUD.
+ * @param queue_depth   Number of events waiting in the pipeline.
+ * @param dropped_full  Total number of events dropped on a full pipeline.
+ * @param dropped_stale Total number of events dropped for their age.
+ *
+ * @return Record with one item per counter, the caller holds the only
+ *         reference.
+ */
+mdp_record *hud_sample(const hud_handle handle,
+                       guint queue_depth,
+                       guint dropped_full,
+                       guint dropped_stale);
+
+#endif // INCLUSION_GUARD_HUD_H
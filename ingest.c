@@ -0,0 +1,1130 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <glib-unix.h>
+#include <glib/gprintf.h>
+
+#include <syslog.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "ingest.h"
+#include "content_filter.h"
+#include "debug.h"
+
+/** @file ingest.c
+ * @Brief Implementation of the local socket ingest endpoint.
+ *
+ * SOCK_SEQPACKET keeps the packet boundaries so every recv() returns exactly
+ * one framed record. Producer sockets are read with MSG_DONTWAIT so they do
+ * not need to be non-blocking. Packets are read into one buffer owned by the handle
+ * and parsed into a message with a fixed field table and a text arena, so
+ * parsing does not allocate. ingest_lookup() lends out the strings of the
+ * arena instead of copying them. A few packets are handled per wakeup to
+ * not starve other sources in the GMainLoop.
+ */
+
+/******************** MACRO DEFINITION SECTION ********************************/
+
+/**
+ * Largest accepted packet, header included.
+ */
+#define MAX_PACKET_SIZE (65536)
+
+/**
+ * Size of the arena holding keys and string values of one record. Flattened
+ * JSON keys repeat their parent keys so allow for more than the packet.
+ */
+#define TEXT_SIZE       (2 * MAX_PACKET_SIZE)
+
+/**
+ * Max number of fields in one record.
+ */
+#define MAX_FIELDS      (256)
+
+/**
+ * Max nesting of JSON objects and max length of a flattened key prefix.
+ */
+#define MAX_DEPTH       (8)
+#define MAX_PREFIX_SIZE (256)
+
+/**
+ * Max number of connected producers.
+ */
+#define MAX_CLIENTS     (16)
+
+/**
+ * Max number of packets read from one producer per wakeup.
+ */
+#define MAX_BATCH       (64)
+
+/**
+ * Frame header, format byte and 32 bit payload length.
+ */
+#define HEADER_SIZE     (5)
+#define FORMAT_JSON     'J'
+#define FORMAT_BINARY   'B'
+
+/**
+ * Log every this many rejected records to not flood syslog.
+ */
+#define REJECT_LOG_INTERVAL (100)
+
+/******************** LOCAL VARIABLE DECLARATION SECTION **********************/
+
+/**
+ * One field of a received record, key and string point into the arena.
+ */
+typedef struct ingest_field
+{
+    const gchar         *key;
+    content_filter_type type;
+    union {
+        const gchar *string;
+        gboolean    boolean;
+        gint64      integer;
+        gdouble     number;
+    } value;
+} ingest_field;
+
+struct ingest_message
+{
+    guint        n_fields;
+    ingest_field fields[MAX_FIELDS];
+    gsize        text_used;
+    gchar        text[TEXT_SIZE];
+};
+
+/**
+ * One connected producer.
+ */
+typedef struct ingest_client
+{
+    struct ingest *ingest;
+    gint          fd;
+    guint         source;
+} ingest_client;
+
+typedef struct ingest
+{
+    gchar           *path;
+    gint            fd;
+    guint           source;
+    GList           *clients;
+    guint           received;
+    guint           rejected;
+
+    ingest_callback callback;
+    gpointer        user_data;
+
+    gchar           buffer[MAX_PACKET_SIZE + 1];
+    ingest_message  message;
+} ingest;
+
+/**
+ * State while parsing a JSON payload.
+ */
+typedef struct json_parser
+{
+    const gchar    *pos;
+    const gchar    *end;
+    ingest_message *message;
+    gsize          prefix_len;
+    gchar          prefix[MAX_PREFIX_SIZE];
+} json_parser;
+
+/******************** LOCAL FUNCTION DECLARATION SECTION **********************/
+
+/**
+ * GMainLoop callback accepting new producers on the listening socket.
+ *
+ * @param fd        The listening socket.
+ * @param condition The triggered condition.
+ * @param user_data The ingest handle.
+ *
+ * @return G_SOURCE_CONTINUE to keep listening.
+ */
+static gboolean accept_clients(gint fd,
+                               GIOCondition condition,
+                               gpointer user_data);
+
+/**
+ * GMainLoop callback reading records from a producer.
+ *
+ * @param fd        The producer socket.
+ * @param condition The triggered condition.
+ * @param user_data The ingest_client.
+ *
+ * @return G_SOURCE_CONTINUE, G_SOURCE_REMOVE when the producer is gone.
+ */
+static gboolean read_client(gint fd,
+                            GIOCondition condition,
+                            gpointer user_data);
+
+/**
+ * Close a producer connection and free it.
+ *
+ * @param client The producer.
+ *
+ * @return No return value.
+ */
+static void close_client(ingest_client *client);
+
+/**
+ * Parse a framed packet in the handle buffer into the handle message.
+ *
+ * @param handle The ingest handle.
+ * @param size   Size of the packet.
+ *
+ * @return TRUE on success, FALSE if the packet is malformed.
+ */
+static gboolean parse_packet(const ingest_handle handle, gsize size);
+
+/**
+ * Parse a binary payload.
+ *
+ * @param message The message to fill in.
+ * @param data    The payload.
+ * @param size    Size of the payload.
+ *
+ * @return TRUE on success, FALSE if the payload is malformed.
+ */
+static gboolean parse_binary(ingest_message *message,
+                             const guchar *data,
+                             gsize size);
+
+/**
+ * Parse a JSON object, nested objects recursively.
+ *
+ * @param parser The parser positioned at the opening brace.
+ * @param depth  Current nesting depth.
+ *
+ * @return TRUE on success, FALSE if the object is malformed.
+ */
+static gboolean json_object(json_parser *parser, guint depth);
+
+/**
+ * Parse a JSON string and append it unescaped to the text arena.
+ *
+ * @param parser The parser positioned at the opening quote.
+ *
+ * @return TRUE on success, FALSE if the string is malformed.
+ */
+static gboolean json_string(json_parser *parser);
+
+/**
+ * Read the code point of a JSON \u escape.
+ *
+ * @param parser     The parser positioned after the u.
+ * @param code_point Return location for the code point.
+ *
+ * @return TRUE on success, FALSE on bad digits, lone surrogates and NUL.
+ */
+static gboolean json_code_point(json_parser *parser, gunichar *code_point);
+
+/**
+ * Read four hex digits.
+ *
+ * @param parser The parser positioned at the digits.
+ * @param value  Return location for the value.
+ *
+ * @return TRUE on success, FALSE if not four hex digits.
+ */
+static gboolean json_hex(json_parser *parser, gunichar *value);
+
+/**
+ * Parse a JSON scalar value into a field.
+ *
+ * @param parser The parser positioned at the value.
+ * @param field  The field to fill in, type is left unknown for null.
+ *
+ * @return TRUE on success, FALSE if the value is malformed.
+ */
+static gboolean json_value(json_parser *parser, ingest_field *field);
+
+/**
+ * Skip JSON white space.
+ *
+ * @param parser The parser.
+ *
+ * @return No return value.
+ */
+static void json_skip_space(json_parser *parser);
+
+/**
+ * Append text to the arena of a message.
+ *
+ * @param message The message.
+ * @param data    The text.
+ * @param length  Length of the text.
+ *
+ * @return TRUE on success, FALSE if the arena is full.
+ */
+static gboolean text_append(ingest_message *message,
+                            const gchar *data,
+                            gsize length);
+
+/**
+ * Terminate text appended to the arena of a message.
+ *
+ * @param message The message.
+ * @param start   Arena offset where the text started.
+ *
+ * @return The terminated text, NULL if the arena is full.
+ */
+static const gchar *text_finish(ingest_message *message, gsize start);
+
+/******************** LOCAL FUNCTION DEFINTION SECTION ************************/
+
+/**
+ * Accept producers, sockets are non-blocking so accept until none is left.
+ */
+static gboolean accept_clients(gint fd,
+                               GIOCondition condition,
+                               gpointer user_data)
+{
+    ingest_handle handle = user_data;
+
+    (void) condition;
+
+    for (;;) {
+        gint client_fd = accept(fd, NULL, NULL);
+
+        if (client_fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ERR("Failed to accept ingest client: %s", g_strerror(errno));
+            }
+
+            break;
+        }
+
+        if (g_list_length(handle->clients) >= MAX_CLIENTS) {
+            LOG("Too many ingest clients, connection refused");
+            close(client_fd);
+            continue;
+        }
+
+        /* Not inherited by the commands spawned to reach ACS */
+        fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+
+        ingest_client *client = g_new0(ingest_client, 1);
+        client->ingest        = handle;
+        client->fd            = client_fd;
+        client->source        = g_unix_fd_add(client_fd,
+            G_IO_IN | G_IO_HUP | G_IO_ERR, read_client, client);
+
+        handle->clients = g_list_prepend(handle->clients, client);
+
+        DBG_LOG("Ingest client connected on fd %d", client_fd);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * Read and dispatch records from a producer.
+ */
+static gboolean read_client(gint fd,
+                            GIOCondition condition,
+                            gpointer user_data)
+{
+    ingest_client *client = user_data;
+    ingest_handle handle  = client->ingest;
+
+    (void) condition;
+
+    guint i = 0;
+    for (; i < MAX_BATCH; i++) {
+        /* MSG_TRUNC returns the real size of a packet too large to fit */
+        ssize_t size = recv(fd, handle->buffer, MAX_PACKET_SIZE,
+            MSG_DONTWAIT | MSG_TRUNC);
+
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return G_SOURCE_CONTINUE;
+            }
+
+            ERR("Failed to read from ingest client: %s", g_strerror(errno));
+            break;
+        }
+
+        /* Producer closed the connection */
+        if (size == 0) {
+            break;
+        }
+
+        if (size <= MAX_PACKET_SIZE && parse_packet(handle, size)) {
+            handle->received++;
+            handle->callback(&handle->message, handle->user_data);
+        } else if (handle->rejected++ % REJECT_LOG_INTERVAL == 0) {
+            LOG("Rejected malformed ingest record, %u in total",
+                handle->rejected);
+        }
+    }
+
+    /* More packets may be waiting, leave them for the next dispatch */
+    if (i == MAX_BATCH) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    DBG_LOG("Ingest client on fd %d disconnected", fd);
+
+    handle->clients = g_list_remove(handle->clients, client);
+    client->source  = 0;
+    close_client(client);
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Close a producer connection.
+ */
+static void close_client(ingest_client *client)
+{
+    if (client->source != 0) {
+        g_source_remove(client->source);
+    }
+
+    close(client->fd);
+    g_free(client);
+}
+
+/**
+ * Check the frame header and parse the payload with its format.
+ */
+static gboolean parse_packet(const ingest_handle handle, gsize size)
+{
+    const guchar *data      = (const guchar *) handle->buffer;
+    ingest_message *message = &handle->message;
+
+    message->n_fields  = 0;
+    message->text_used = 0;
+
+    if (size < HEADER_SIZE) {
+        return FALSE;
+    }
+
+    guint32 length = ((guint32) data[1] << 24) | ((guint32) data[2] << 16) |
+        ((guint32) data[3] << 8) | data[4];
+
+    if (length != size - HEADER_SIZE) {
+        return FALSE;
+    }
+
+    if (data[0] == FORMAT_BINARY) {
+        return parse_binary(message, data + HEADER_SIZE, length);
+    }
+
+    if (data[0] != FORMAT_JSON) {
+        return FALSE;
+    }
+
+    json_parser parser = {
+        .pos     = handle->buffer + HEADER_SIZE,
+        .end     = handle->buffer + size,
+        .message = message,
+    };
+
+    json_skip_space(&parser);
+
+    if (!json_object(&parser, 0)) {
+        return FALSE;
+    }
+
+    json_skip_space(&parser);
+
+    return parser.pos == parser.end;
+}
+
+/**
+ * Parse binary fields until the payload ends. Keys and strings are copied
+ * to the arena to get them terminated.
+ */
+static gboolean parse_binary(ingest_message *message,
+                             const guchar *data,
+                             gsize size)
+{
+    const guchar *end = data + size;
+
+    while (data < end) {
+        if (message->n_fields == MAX_FIELDS || end - data < 2) {
+            return FALSE;
+        }
+
+        ingest_field *field = &message->fields[message->n_fields];
+        guchar type         = data[0];
+        gsize key_length    = data[1];
+        gsize start         = message->text_used;
+
+        data += 2;
+
+        if (key_length == 0 || (gsize) (end - data) < key_length ||
+            memchr(data, '\0', key_length) != NULL ||
+            !text_append(message, (const gchar *) data, key_length)) {
+            return FALSE;
+        }
+
+        field->key = text_finish(message, start);
+        data      += key_length;
+
+        if (field->key == NULL) {
+            return FALSE;
+        }
+
+        guint64 bits = 0;
+        gsize length = 0;
+        gsize i      = 0;
+
+        switch (type) {
+        case 's':
+            if (end - data < 2) {
+                return FALSE;
+            }
+
+            length = ((gsize) data[0] << 8) | data[1];
+            data  += 2;
+            start  = message->text_used;
+
+            if ((gsize) (end - data) < length ||
+                memchr(data, '\0', length) != NULL ||
+                !text_append(message, (const gchar *) data, length)) {
+                return FALSE;
+            }
+
+            field->type         = CONTENT_FILTER_TYPE_STRING;
+            field->value.string = text_finish(message, start);
+            data               += length;
+
+            if (field->value.string == NULL) {
+                return FALSE;
+            }
+            break;
+        case 'b':
+            if (end - data < 1) {
+                return FALSE;
+            }
+
+            field->type          = CONTENT_FILTER_TYPE_BOOLEAN;
+            field->value.boolean = data[0] != 0;
+            data                += 1;
+            break;
+        case 'i':
+        case 'd':
+            if (end - data < 8) {
+                return FALSE;
+            }
+
+            for (; i < 8; i++) {
+                bits = (bits << 8) | data[i];
+            }
+
+            data += 8;
+
+            if (type == 'i') {
+                field->type          = CONTENT_FILTER_TYPE_INTEGER;
+                field->value.integer = (gint64) bits;
+            } else {
+                field->type = CONTENT_FILTER_TYPE_DOUBLE;
+                memcpy(&field->value.number, &bits, sizeof(bits));
+            }
+            break;
+        default:
+            return FALSE;
+        }
+
+        message->n_fields++;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Parse the members of an object. Keys are stored with the prefix of the
+ * enclosing objects, the key of a nested object becomes the new prefix.
+ */
+static gboolean json_object(json_parser *parser, guint depth)
+{
+    ingest_message *message = parser->message;
+    gsize prefix_len        = parser->prefix_len;
+
+    if (parser->pos == parser->end || *parser->pos != '{') {
+        return FALSE;
+    }
+
+    parser->pos++;
+    json_skip_space(parser);
+
+    if (parser->pos < parser->end && *parser->pos == '}') {
+        parser->pos++;
+        return TRUE;
+    }
+
+    for (;;) {
+        gsize start = message->text_used;
+
+        if (!text_append(message, parser->prefix, prefix_len) ||
+            !json_string(parser)) {
+            return FALSE;
+        }
+
+        const gchar *key = text_finish(message, start);
+
+        if (key == NULL) {
+            return FALSE;
+        }
+
+        json_skip_space(parser);
+
+        if (parser->pos == parser->end || *parser->pos != ':') {
+            return FALSE;
+        }
+
+        parser->pos++;
+        json_skip_space(parser);
+
+        if (parser->pos < parser->end && *parser->pos == '{') {
+            gsize key_len = strlen(key);
+
+            /* The key already holds the current prefix */
+            if (depth + 1 >= MAX_DEPTH || key_len + 1 >= MAX_PREFIX_SIZE) {
+                return FALSE;
+            }
+
+            memcpy(parser->prefix, key, key_len);
+            parser->prefix[key_len] = '.';
+            parser->prefix_len      = key_len + 1;
+
+            gboolean ret = json_object(parser, depth + 1);
+
+            parser->prefix_len = prefix_len;
+
+            if (!ret) {
+                return FALSE;
+            }
+        } else {
+            if (message->n_fields == MAX_FIELDS) {
+                return FALSE;
+            }
+
+            ingest_field *field = &message->fields[message->n_fields];
+            field->key          = key;
+            field->type         = CONTENT_FILTER_TYPE_UNKNOWN;
+
+            if (!json_value(parser, field)) {
+                return FALSE;
+            }
+
+            /* Null values are left out */
+            if (field->type != CONTENT_FILTER_TYPE_UNKNOWN) {
+                message->n_fields++;
+            }
+        }
+
+        json_skip_space(parser);
+
+        if (parser->pos == parser->end) {
+            return FALSE;
+        }
+
+        if (*parser->pos == '}') {
+            parser->pos++;
+            return TRUE;
+        }
+
+        if (*parser->pos != ',') {
+            return FALSE;
+        }
+
+        parser->pos++;
+        json_skip_space(parser);
+    }
+}
+
+/**
+ * Unescape a string into the arena. Escaped NUL characters are rejected
+ * since values are handled as C strings.
+ */
+static gboolean json_string(json_parser *parser)
+{
+    ingest_message *message = parser->message;
+
+    if (parser->pos == parser->end || *parser->pos != '"') {
+        return FALSE;
+    }
+
+    parser->pos++;
+
+    while (parser->pos < parser->end) {
+        gchar c = *parser->pos++;
+
+        if (c == '"') {
+            return TRUE;
+        }
+
+        if ((guchar) c < 0x20) {
+            return FALSE;
+        }
+
+        if (c != '\\') {
+            if (!text_append(message, &c, 1)) {
+                return FALSE;
+            }
+            continue;
+        }
+
+        if (parser->pos == parser->end) {
+            return FALSE;
+        }
+
+        c = *parser->pos++;
+
+        if (c == 'u') {
+            gchar utf8[6];
+            gunichar code_point;
+
+            if (!json_code_point(parser, &code_point)) {
+                return FALSE;
+            }
+
+            if (!text_append(message, utf8,
+                g_unichar_to_utf8(code_point, utf8))) {
+                return FALSE;
+            }
+            continue;
+        }
+
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            break;
+        case 'b':
+            c = '\b';
+            break;
+        case 'f':
+            c = '\f';
+            break;
+        case 'n':
+            c = '\n';
+            break;
+        case 'r':
+            c = '\r';
+            break;
+        case 't':
+            c = '\t';
+            break;
+        default:
+            return FALSE;
+        }
+
+        if (!text_append(message, &c, 1)) {
+            return FALSE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Read the code point of a \u escape, a surrogate pair is read in full.
+ */
+static gboolean json_code_point(json_parser *parser, gunichar *code_point)
+{
+    gunichar low = 0;
+
+    if (!json_hex(parser, code_point)) {
+        return FALSE;
+    }
+
+    if (*code_point >= 0xd800 && *code_point < 0xdc00) {
+        if (parser->end - parser->pos < 2 || parser->pos[0] != '\\' ||
+            parser->pos[1] != 'u') {
+            return FALSE;
+        }
+
+        parser->pos += 2;
+
+        if (!json_hex(parser, &low) || low < 0xdc00 || low >= 0xe000) {
+            return FALSE;
+        }
+
+        *code_point = 0x10000 + ((*code_point - 0xd800) << 10) +
+            (low - 0xdc00);
+    } else if (*code_point >= 0xdc00 && *code_point < 0xe000) {
+        return FALSE;
+    }
+
+    return *code_point != 0;
+}
+
+/**
+ * Read four hex digits.
+ */
+static gboolean json_hex(json_parser *parser, gunichar *value)
+{
+    *value = 0;
+
+    guint i = 0;
+    for (; i < 4; i++) {
+        if (parser->pos == parser->end) {
+            return FALSE;
+        }
+
+        gint digit = g_ascii_xdigit_value(*parser->pos++);
+
+        if (digit < 0) {
+            return FALSE;
+        }
+
+        *value = (*value << 4) | digit;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Parse a scalar value. Numbers without fraction or exponent that fit 64
+ * bits are integers, all others doubles. Arrays are not supported.
+ */
+static gboolean json_value(json_parser *parser, ingest_field *field)
+{
+    ingest_message *message = parser->message;
+    gsize left              = parser->end - parser->pos;
+    gsize start             = message->text_used;
+
+    if (left == 0) {
+        return FALSE;
+    }
+
+    switch (*parser->pos) {
+    case '"':
+        if (!json_string(parser)) {
+            return FALSE;
+        }
+
+        field->type         = CONTENT_FILTER_TYPE_STRING;
+        field->value.string = text_finish(message, start);
+
+        return field->value.string != NULL;
+    case 't':
+        if (left < 4 || memcmp(parser->pos, "true", 4) != 0) {
+            return FALSE;
+        }
+
+        field->type          = CONTENT_FILTER_TYPE_BOOLEAN;
+        field->value.boolean = TRUE;
+        parser->pos         += 4;
+
+        return TRUE;
+    case 'f':
+        if (left < 5 || memcmp(parser->pos, "false", 5) != 0) {
+            return FALSE;
+        }
+
+        field->type          = CONTENT_FILTER_TYPE_BOOLEAN;
+        field->value.boolean = FALSE;
+        parser->pos         += 5;
+
+        return TRUE;
+    case 'n':
+        if (left < 4 || memcmp(parser->pos, "null", 4) != 0) {
+            return FALSE;
+        }
+
+        parser->pos += 4;
+
+        return TRUE;
+    default:
+        break;
+    }
+
+    /* Copy the number to get it terminated for the conversion */
+    gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+    gboolean fraction = FALSE;
+    gsize length      = 0;
+
+    while (length < left) {
+        gchar c = parser->pos[length];
+
+        if (c == '.' || c == 'e' || c == 'E') {
+            fraction = TRUE;
+        } else if (!g_ascii_isdigit(c) && c != '-' && c != '+') {
+            break;
+        }
+
+        length++;
+    }
+
+    if (length == 0 || length >= sizeof(number)) {
+        return FALSE;
+    }
+
+    memcpy(number, parser->pos, length);
+    number[length] = '\0';
+
+    gchar *number_end = NULL;
+
+    if (!fraction) {
+        errno = 0;
+        field->value.integer = g_ascii_strtoll(number, &number_end, 10);
+
+        if (errno == 0 && number_end == number + length) {
+            field->type  = CONTENT_FILTER_TYPE_INTEGER;
+            parser->pos += length;
+            return TRUE;
+        }
+    }
+
+    field->value.number = g_ascii_strtod(number, &number_end);
+
+    if (number_end != number + length) {
+        return FALSE;
+    }
+
+    field->type  = CONTENT_FILTER_TYPE_DOUBLE;
+    parser->pos += length;
+
+    return TRUE;
+}
+
+/**
+ * Skip JSON white space.
+ */
+static void json_skip_space(json_parser *parser)
+{
+    while (parser->pos < parser->end && (*parser->pos == ' ' ||
+        *parser->pos == '\t' || *parser->pos == '\n' || *parser->pos == '\r')) {
+        parser->pos++;
+    }
+}
+
+/**
+ * Append text to the arena, always leaving room for the terminator.
+ */
+static gboolean text_append(ingest_message *message,
+                            const gchar *data,
+                            gsize length)
+{
+    if (length >= TEXT_SIZE - message->text_used) {
+        return FALSE;
+    }
+
+    memcpy(message->text + message->text_used, data, length);
+    message->text_used += length;
+
+    return TRUE;
+}
+
+/**
+ * Terminate text in the arena.
+ */
+static const gchar *text_finish(ingest_message *message, gsize start)
+{
+    if (message->text_used >= TEXT_SIZE) {
+        return NULL;
+    }
+
+    message->text[message->text_used++] = '\0';
+
+    return message->text + start;
+}
+
+/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
+
+/**
+ * Create the socket and start listening.
+ */
+ingest_handle ingest_init(const char *path,
+                          ingest_callback callback,
+                          gpointer user_data,
+                          char **error)
+{
+    struct sockaddr_un address;
+    struct stat        status;
+
+    g_assert(error);
+    g_assert(callback);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (path == NULL || strlen(path) >= sizeof(address.sun_path)) {
+        *error = g_strdup("Invalid ingest socket path");
+        return NULL;
+    }
+
+    g_strlcpy(address.sun_path, path, sizeof(address.sun_path));
+
+    /**
+     * Left behind by a previous run, never remove anything but a socket and
+     * only when nobody answers on it, a refused connection means stale.
+     */
+    if (lstat(path, &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            *error = g_strdup_printf("%s exists and is not a socket", path);
+            return NULL;
+        }
+
+        gint probe = socket(AF_UNIX,
+            SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        if (probe < 0) {
+            *error = g_strdup_printf("Failed to create socket: %s",
+                g_strerror(errno));
+            return NULL;
+        }
+
+        gint result = connect(probe, (struct sockaddr *) &address,
+            sizeof(address));
+        gint probe_errno = errno;
+
+        close(probe);
+
+        if (result == 0) {
+            *error = g_strdup_printf("%s is in use by another process", path);
+            return NULL;
+        }
+
+        if (probe_errno != ECONNREFUSED) {
+            *error = g_strdup_printf("Failed to check %s: %s", path,
+                g_strerror(probe_errno));
+            return NULL;
+        }
+
+        unlink(path);
+    }
+
+    gint fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+        0);
+
+    if (fd < 0) {
+        *error = g_strdup_printf("Failed to create socket: %s",
+            g_strerror(errno));
+        return NULL;
+    }
+
+    /* Only unlink the path once it is our own socket */
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        *error = g_strdup_printf("Failed to bind %s: %s", path,
+            g_strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    if (listen(fd, MAX_CLIENTS) < 0) {
+        *error = g_strdup_printf("Failed to listen on %s: %s", path,
+            g_strerror(errno));
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+
+    /* Producers are other ACAPs, they share the group of the application */
+    chmod(path, 0660);
+
+    ingest_handle handle = g_new0(ingest, 1);
+    handle->path         = g_strdup(path);
+    handle->fd           = fd;
+    handle->callback     = callback;
+    handle->user_data    = user_data;
+    handle->source       = g_unix_fd_add(fd, G_IO_IN, accept_clients, handle);
+
+    LOG("Listening for ingest records on %s", path);
+
+    return handle;
+}
+
+/**
+ * Close the socket and all producer connections.
+ */
+void ingest_cleanup(ingest_handle *handle_p)
+{
+    if (handle_p == NULL) {
+        return;
+    }
+
+    if (*handle_p == NULL) {
+        return;
+    }
+
+    ingest_handle handle = *handle_p;
+
+    g_list_free_full(handle->clients, (GDestroyNotify) close_client);
+    g_source_remove(handle->source);
+    close(handle->fd);
+    unlink(handle->path);
+
+    LOG("Stopped ingest on %s, %u records received, %u rejected",
+        handle->path, handle->received, handle->rejected);
+
+    g_free(handle->path);
+    g_free(handle);
+
+    *handle_p = NULL;
+}
+
+/**
+ * Look up a field of a received record. The type is known from the record
+ * so the type hint is not needed.
+ */
+gboolean ingest_lookup(const char *key,
+                       content_filter_value *value,
+                       gpointer user_data)
+{
+    const ingest_message *message = user_data;
+
+    guint i = 0;
+    for (; i < message->n_fields; i++) {
+        const ingest_field *field = &message->fields[i];
+
+        if (strcmp(field->key, key) != 0) {
+            continue;
+        }
+
+        value->type = field->type;
+
+        switch (field->type) {
+        case CONTENT_FILTER_TYPE_STRING:
+            /* Valid as long as the message, no copy needed */
+            value->string   = (gchar *) field->value.string;
+            value->borrowed = TRUE;
+            break;
+        case CONTENT_FILTER_TYPE_BOOLEAN:
+            value->boolean = field->value.boolean;
+            break;
+        case CONTENT_FILTER_TYPE_INTEGER:
+            /* Filter integers are 32 bits, wider values compare as double */
+            if (field->value.integer >= G_MININT &&
+                field->value.integer <= G_MAXINT) {
+                value->integer = (gint) field->value.integer;
+            } else {
+                value->type   = CONTENT_FILTER_TYPE_DOUBLE;
+                value->number = (gdouble) field->value.integer;
+            }
+            break;
+        case CONTENT_FILTER_TYPE_DOUBLE:
+            value->number = field->value.number;
+            break;
+        default:
+            return FALSE;
+        }
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
@@ -0,0 +1,92 @@
+#ifndef INCLUSION_GUARD_INGEST_H
+#define INCLUSION_GUARD_INGEST_H
+
+#include <glib.h>
+
+#include "content_filter.h"
+
+/** @file ingest.h
+ * @Brief Local socket endpoint for metadata records pushed by other ACAPs.
+ *
+ * Listens on a Unix domain SOCK_SEQPACKET socket in the GMainLoop. Every
+ * packet is one framed record:
+ *
+ * - byte 0     Format, 'J' for JSON or 'B' for binary.
+ * - bytes 1-4  Payload length, big endian.
+ * - payload    The record.
+ *
+ * A JSON payload is one object with string, number, true and false values.
+ * Nested objects are flattened into dotted keys, e.g. {"car":{"plate":"A"}}
+ * gives the key car.plate. Null values are left out.
+ *
+ * A binary payload is a sequence of fields, all integers big endian:
+ *
+ * - type       One byte, 's' string, 'b' boolean, 'i' integer, 'd' double.
+ * - key length One byte, followed by the key.
+ * - value      's' two byte length followed by the string, 'b' one byte,
+ *              'i' eight byte signed integer, 'd' eight byte IEEE 754.
+ *
+ * Records are handed to the callback as a message that is looked up with
+ * ingest_lookup(), the same way the content filter looks up event values.
+ */
+
+/**
+ * Forward-declared handle for ingest object.
+ */
+typedef struct ingest* ingest_handle;
+
+/**
+ * One parsed record, only valid during the callback.
+ */
+typedef struct ingest_message ingest_message;
+
+/**
+ * Function called in the GMainLoop for every received record.
+ *
+ * @param message   The parsed record.
+ * @param user_data User data given to ingest_init().
+ *
+ * @return No return value.
+ */
+typedef void (*ingest_callback)(const ingest_message *message,
+                                gpointer user_data);
+
+/**
+ * Create the socket and start listening for producers.
+ *
+ * @param path      File system path of the socket, replaced if it exists.
+ * @param callback  Function called for every received record.
+ * @param user_data User data passed on to the callback.
+ * @param error     Mandatory location to place error message on failure.
+ *
+ * @return Handle for the endpoint, NULL on failure.
+ */
+ingest_handle ingest_init(const char *path,
+                          ingest_callback callback,
+                          gpointer user_data,
+                          char **error);
+
+/**
+ * Close all connections, remove the socket and deallocate resources.
+ *
+ * @param handle_p Pointer to the handle, set to NULL on return.
+ *
+ * @return No return value.
+ */
+void ingest_cleanup(ingest_handle *handle_p);
+
+/**
+ * Content filter lookup function getting values from a received record.
+ *
+ * @param key       Name of the key to look up.
+ * @param value     Return location for the value. Strings are borrowed
+ *                  from the message and only valid during the callback.
+ * @param user_data The ingest_message given to the callback.
+ *
+ * @return TRUE if the key was found, FALSE otherwise.
+ */
+gboolean ingest_lookup(const char *key,
+                       content_filter_value *value,
+                       gpointer user_data);
+
+#endif // INCLUSION_GUARD_INGEST_H
@@ -0,0 +1,254 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gprintf.h>
+
+#include <syslog.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "item_plan.h"
+#include "metadata_pair.h"
+#include "content_filter.h"
+#include "debug.h"
+
+/** @file item_plan.c
+ * @Brief Implementation of the precompiled metadata item extraction plan.
+ *
+ * The value type of each item is not known from the parameters, so it is
+ * learned from the first record carrying the item and cached in the plan as
+ * lookup hint. Should a later record carry the item with another type the
+ * lookup probes the item again.
+ */
+
+/******************** MACRO DEFINITION SECTION ********************************/
+
+/**
+ * Value used for all items when generating a test report.
+ */
+#define TEST_VALUE "TEST"
+
+/******************** LOCAL VARIABLE DECLARATION SECTION **********************/
+
+/**
+ * One planned item.
+ */
+typedef struct item_entry
+{
+    gchar               *key;
+    const gchar         *display_name;
+    content_filter_type type;
+} item_entry;
+
+typedef struct item_plan
+{
+    gint       ref_count;
+    guint      n_items;
+    item_entry *entries;
+} item_plan;
+
+/******************** LOCAL FUNCTION DECLARATION SECTION **********************/
+
+/**
+ * Look up the value of an item, using the resolved type of the entry as
+ * hint, and store it in the record.
+ *
+ * @param entry     The planned item, type is updated on success.
+ * @param lookup    Function used to look up the value.
+ * @param user_data User data passed on to the lookup function.
+ * @param record_p  The record to store the item in.
+ * @param index     Index of the item in the record.
+ *
+ * @return TRUE if stored, FALSE if not found.
+ */
+static gboolean get_value(item_entry *entry,
+                          content_filter_lookup lookup,
+                          gpointer user_data,
+                          mdp_record **record_p,
+                          guint index);
+
+/******************** LOCAL FUNCTION DEFINTION SECTION ************************/
+
+/**
+ * Look up the value of an item. The lookup tries the cached type first and
+ * only probes the other types when the item is seen for the first time or
+ * its type has changed. Values are stored with their native type, strings
+ * are copied into the record arena.
+ */
+static gboolean get_value(item_entry *entry,
+                          content_filter_lookup lookup,
+                          gpointer user_data,
+                          mdp_record **record_p,
+                          guint index)
+{
+    content_filter_value value = { .type = entry->type };
+
+    if (!lookup(entry->key, &value, user_data)) {
+        return FALSE;
+    }
+
+    if (value.type != entry->type) {
+        DBG_LOG("Resolved type %d for item %s", value.type, entry->key);
+        entry->type = value.type;
+    }
+
+    switch (value.type) {
+    case CONTENT_FILTER_TYPE_STRING:
+        mdp_record_set_string(record_p, index, entry->display_name,
+            value.string);
+        content_filter_value_clear(&value);
+        return TRUE;
+    case CONTENT_FILTER_TYPE_BOOLEAN:
+        mdp_record_set_boolean(*record_p, index, entry->display_name,
+            value.boolean);
+        return TRUE;
+    case CONTENT_FILTER_TYPE_INTEGER:
+        mdp_record_set_integer(*record_p, index, entry->display_name,
+            value.integer);
+        return TRUE;
+    case CONTENT_FILTER_TYPE_DOUBLE:
+        mdp_record_set_double(*record_p, index, entry->display_name,
+            value.number);
+        return TRUE;
+    default:
+        break;
+    }
+
+    return FALSE;
+}
+
+/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
+
+/**
+ * Compile item extraction plan.
+ */
+item_plan_handle item_plan_init(const char *items)
+{
+    if (items == NULL) {
+        return NULL;
+    }
+
+    gchar **data_items = g_strsplit(items, ";", -1);
+    guint n_tokens     = g_strv_length(data_items);
+
+    item_plan_handle handle = g_new0(item_plan, 1);
+    handle->ref_count       = 1;
+    handle->entries         = g_new0(item_entry, n_tokens);
+
+    guint i = 0;
+    for (; i < n_tokens; i++) {
+        gchar *key = g_strstrip(data_items[i]);
+
+        if (*key == '\0') {
+            continue;
+        }
+
+        item_entry *entry = &handle->entries[handle->n_items++];
+        entry->key        = g_strdup(key);
+        entry->type       = CONTENT_FILTER_TYPE_UNKNOWN;
+
+        /**
+         * Capitalize first character to make it look better in ACS. Names
+         * are interned once here and only passed by pointer per event.
+         */
+        key[0] = g_ascii_toupper(key[0]);
+        entry->display_name = g_intern_string(key);
+    }
+
+    g_strfreev(data_items);
+
+    if (handle->n_items == 0) {
+        item_plan_cleanup(&handle);
+        return NULL;
+    }
+
+    return handle;
+}
+
+/**
+ * Take a reference to an item plan.
+ */
+item_plan_handle item_plan_ref(const item_plan_handle handle)
+{
+    if (handle != NULL) {
+        g_atomic_int_inc(&handle->ref_count);
+    }
+
+    return handle;
+}
+
+/**
+ * Drop a reference, cleanup item plan with the last one.
+ */
+void item_plan_cleanup(item_plan_handle *handle_p)
+{
+    if (handle_p == NULL) {
+        return;
+    }
+
+    if (*handle_p == NULL) {
+        return;
+    }
+
+    item_plan_handle handle = *handle_p;
+
+    *handle_p = NULL;
+
+    if (!g_atomic_int_dec_and_test(&handle->ref_count)) {
+        return;
+    }
+
+    guint i = 0;
+    for (; i < handle->n_items; i++) {
+        g_free(handle->entries[i].key);
+    }
+
+    g_free(handle->entries);
+    g_free(handle);
+}
+
+/**
+ * Build record of key-value pairs with metadata info.
+ */
+gboolean item_plan_extract(const item_plan_handle handle,
+                           content_filter_lookup lookup,
+                           gpointer user_data,
+                           mdp_record **record_p)
+{
+    g_assert(record_p);
+
+    *record_p = NULL;
+
+    if (handle == NULL) {
+        ERR("No metadata items configured");
+        return FALSE;
+    }
+
+    /* One arena block sized from the plan, reused from the pool */
+    mdp_record *record = mdp_record_new(handle->n_items);
+
+    guint i = 0;
+    for (; i < handle->n_items; i++) {
+        item_entry *entry = &handle->entries[i];
+        gboolean found    = FALSE;
+
+        if (lookup == NULL) {
+            mdp_record_set_string(&record, i, entry->display_name,
+                TEST_VALUE);
+            found = TRUE;
+        } else {
+            found = get_value(entry, lookup, user_data, &record, i);
+        }
+
+        /* Leave and clean up if couldn't find some of the data */
+        if (found == FALSE) {
+            ERR("Failed to get %s information", entry->key);
+            mdp_record_unref(&record);
+            return FALSE;
+        }
+    }
+
+    *record_p = record;
+
+    return TRUE;
+}
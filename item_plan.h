@@ -0,0 +1,68 @@
+#ifndef INCLUSION_GUARD_ITEM_PLAN_H
+#define INCLUSION_GUARD_ITEM_PLAN_H
+
+#include <glib.h>
+
+#include "metadata_pair.h"
+#include "content_filter.h"
+
+/** @file item_plan.h
+ * @Brief Precompiled extraction plan for the configured metadata items.
+ *
+ * The Items parameter is parsed once when it changes into a plan holding
+ * the item keys, their display names and the resolved value type of each
+ * key. Records are then extracted with exactly one typed lookup per item,
+ * using the same lookup functions as the content filter so events and
+ * ingested records share one extraction path.
+ */
+
+/**
+ * Forward-declared handle for item plan object.
+ */
+typedef struct item_plan* item_plan_handle;
+
+/**
+ * Compile an item extraction plan.
+ *
+ * @param items Semi-colon separated list of item keys, e.g. plate;country;
+ *
+ * @return Handle for the compiled plan, NULL if there is nothing to extract.
+ */
+item_plan_handle item_plan_init(const char *items);
+
+/**
+ * Take a reference to a compiled plan. Safe to call from any thread.
+ *
+ * @param handle The plan, may be NULL.
+ *
+ * @return The plan.
+ */
+item_plan_handle item_plan_ref(const item_plan_handle handle);
+
+/**
+ * Drop a reference to an item plan, the last one deallocates resources.
+ * Safe to call from any thread.
+ *
+ * @param handle_p Pointer to the handle, set to NULL on return.
+ *
+ * @return No return value.
+ */
+void item_plan_cleanup(item_plan_handle *handle_p);
+
+/**
+ * Extract the planned items from an event into a metadata record.
+ *
+ * @param handle    The compiled plan.
+ * @param lookup    Function used to look up the item values. If NULL all
+ *                  items get the value TEST, used for test reporting.
+ * @param user_data User data passed on to the lookup function.
+ * @param record_p  Return location for the record.
+ *
+ * @return TRUE on success, FALSE if an item is missing.
+ */
+gboolean item_plan_extract(const item_plan_handle handle,
+                           content_filter_lookup lookup,
+                           gpointer user_data,
+                           mdp_record **record_p);
+
+#endif // INCLUSION_GUARD_ITEM_PLAN_H
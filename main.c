@@ -13,8 +13,15 @@
 #include <axoverlay.h>
 
 #include "metadata_pair.h"
+#include "item_plan.h"
+#include "content_filter.h"
+#include "channel_map.h"
+#include "ingest.h"
+#include "pipeline.h"
 #include "overlay.h"
+#include "hud.h"
 #include "camera/camera.h"
+#include "config.h"
 #include "acs.h"
 #include "debug.h"
 
@@ -51,6 +58,25 @@
  * It will use metadata_push.c to interface with ACS and push the event
  * data in to the external data search engine with the correct JSON format.
  *
+ * pipeline.c moves event processing off the GMainLoop. The event callback
+ * only filters and extracts the items, pushing to ACS and updating the
+ * overlay is done on the pipeline thread.
+ *
+ * overlay.c shows the latest items in a video overlay. It runs axoverlay on
+ * its own thread and GMainContext, fed with snapshots from the pipeline.
+ *
+ * hud.c collects the performance counters shown in the overlay instead of
+ * the items when OverlayHud is enabled.
+ *
+ * channel_map.c maps events to camera channels on multi-sensor cameras,
+ * each channel has its own overlay and ACS source ID.
+ *
+ * ingest.c is an optional local socket where other ACAPs can push records
+ * straight into the same filter, extraction and pipeline as the events.
+ *
+ * config.c holds all parameters in immutable snapshots. Each event carries
+ * a reference to the snapshot it was taken with to the pipeline threads.
+ *
  * debug.c is a small file that handles enabling / disabling of dynamic logging.
  *
  * @subsection Application Parameters
@@ -74,6 +100,37 @@
  * - Items         Semi-colon separated and terminated list of data items.
  *                E.g. plate;description;country;
  *
+ * - ContentFilter Expression events must match to be reported, see
+ *                content_filter.h. E.g. country IN (SE, NO) AND speed>50
+ *
+ * - EncodeWorkers Number of threads building ACS commands, 0 for one per
+ *                CPU core.
+ *
+ * - MaxEventAge   Max age in ms of an event when it is encoded, older events
+ *                are dropped so a backlog clears quickly. One limit for all
+ *                events, whatever subscription or ingest client they came
+ *                from. 0, the default, never drops events.
+ *
+ * - ChannelKey    Key of the events holding the channel number, a topic key
+ *                or a data item. " " to not use channels.
+ *
+ * - ChannelSources Semi-colon separated list of channel=source ID pairs,
+ *                e.g. 1=11001;2=11002; Other channels use SourceID.
+ *
+ * - OverlayEnabled Show the items in a video overlay. The overlay is set up
+ *                when there is something to show, when off it is not set up
+ *                at all.
+ *
+ * - OverlayPalette Draw the overlay in a 4-bit palette instead of ARGB32
+ *                to cut overlay memory and bandwidth, if supported.
+ *
+ * - IngestSocket  Path of the local SOCK_SEQPACKET socket accepting records
+ *                pushed by other ACAPs, see ingest.h. " " to disable.
+ *
+ * - OverlayHud    Show performance counters in the overlay instead of the
+ *                items: events/s, queue depth, send latency percentiles,
+ *                dropped events and main loop lag.
+ *
  * - DebugEnabled    = "no" type="bool:no,yes"
  *
  * @subsection CGIs
@@ -106,12 +163,56 @@
 #define APP_NICE_NAME       "MetadataACS"
 
 /**
- * Max number of metadata items
+ * Number of events that can be queued and in flight in the pipeline before
+ * new events are dropped.
+ */
+#define PIPELINE_CAPACITY   (64)
+
+/**
+ * Time in ms to wait for more parameter changes before the event
+ * subscription is changed, the web UI saves parameters one by one.
+ */
+#define RESUBSCRIBE_DELAY   (500)
+
+/**
+ * Time in ms between two updates of the performance HUD.
  */
-#define MAX_ITEMS (20)
+#define HUD_INTERVAL        (1000)
 
 /******************** LOCAL VARIABLE DECLARATION SECTION **********************/
 
+/**
+ * Index of the event pipeline stages.
+ */
+typedef enum event_stage
+{
+    STAGE_ENCODE = 0,
+    STAGE_SEND,
+    STAGE_DISPLAY,
+    NBR_OF_STAGES
+} event_stage;
+
+/**
+ * Metadata of one event passed from the event callback to the pipeline.
+ * Records are recycled, the command buffer keeps its size between events.
+ * Filtering, extraction, encoding and overlay updates then run without
+ * allocating, checked by make test. The AXEvent string getters, the thread
+ * pool queues and spawning cURL still allocate inside the SDK and GLib.
+ */
+typedef struct event_record
+{
+    struct event_record *next;
+    mdp_record          *items;
+    const config        *config;
+    gint64              timestamp;
+    const gchar         *analytic;
+    const gchar         *category;
+    guint               channel;
+    const gchar         *source;
+    GString             *command;
+    gboolean            encoded;
+} event_record;
+
 /**
  * Main context for GLib.
  */
@@ -123,49 +224,72 @@ static GMainLoop *loop;
 static AXEventHandler *event_handler;
 
 /**
- * Subscription ID for zone crossing alarm.
+ * Subscription ID for zone crossing alarm, 0 when not subscribed.
+ */
+static guint event_subscription_id = 0;
+
+/**
+ * Generation of the live subscription, passed as token to the event
+ * callback so events from a replaced subscription are recognized.
  */
-static int event_subscription_id = -1;
+static guint subscription_generation = 0;
 
 /**
-* Extra debug logging enabled or not
+* Analytic and category of the live subscription, the configured analytic
+* and category are applied to these once the debounce timer fires.
 */
-static char *par_debug_enabled = NULL;
+static const gchar *sub_analytic = NULL;
+static const gchar *sub_category = NULL;
 
 /**
-* Selected analytic
+* Number of events dropped for being older than MaxEventAge.
 */
-static char *par_analytic = NULL;
+static gint stale_events = 0;
 
 /**
-* Analytic category
+* Debounce timer for subscription changes, 0 when no change is pending.
 */
-static char *par_category = NULL;
+static guint resubscribe_timer = 0;
 
 /**
-* Selected data items on which to report.
+* Overlay of each channel, NULL until there is something to show or while
+* OverlayEnabled is off. Only changed in the GMainLoop, under the mutex
+* since the display stage reads them from the pipeline.
 */
-static char *par_items = NULL;
+static GMutex         overlay_mutex;
+static overlay_handle ovl_handles[MAX_CHANNELS + 1];
 
 /**
-* Selected data items on which to report.
+* Set when the overlay could not be created, not retried for every event.
 */
-static char *par_filter = NULL;
+static gboolean overlay_failed = FALSE;
 
 /**
-* Handle for metdata push instance
+* Performance counters for the HUD, collected while it is shown.
 */
-static acs_handle acs            = NULL;
+static hud_handle hud = NULL;
 
 /**
-* Handle for overlay instance
+* Timer updating the HUD, 0 when the HUD is off.
 */
-static overlay_handle ovl_handle = NULL;
+static guint hud_timer = 0;
 
 /**
-* List with current metadata information being pushed out
+* Local ingest endpoint, NULL when disabled.
 */
-static GList *cur_metadata_items = NULL;
+static ingest_handle ingest = NULL;
+
+/**
+* Handle for the event processing pipeline
+*/
+static pipeline_handle event_pipeline = NULL;
+
+/**
+* Free event records, taken in the GMainLoop and returned from the pipeline.
+*/
+static GMutex       record_mutex;
+static event_record *free_records = NULL;
+
 
 /******************** LOCAL FUNCTION DECLARATION SECTION **********************/
 
@@ -181,12 +305,188 @@ static GList *cur_metadata_items = NULL;
 static void metadata_event_callback(guint subscription, AXEvent *event,
                                     guint *token);
 
+/**
+ * Callback Function for records received on the ingest socket.
+ *
+ * @param message   The received record.
+ * @param user_data Unused user data.
+ *
+ * @return No return value.
+ */
+static void ingest_record_callback(const ingest_message *message,
+                                   gpointer user_data);
+
+/**
+ * Filter a record, extract the items and hand them to the pipeline. Shared
+ * by events and ingested records, only called from the GMainLoop.
+ *
+ * @param lookup    Function used to look up the record values.
+ * @param user_data User data passed on to the lookup function.
+ * @param timestamp Time of the record in microseconds since the Unix epoch.
+ *
+ * @return No return value.
+ */
+static void submit_record(content_filter_lookup lookup,
+                          gpointer user_data,
+                          gint64 timestamp);
+
+/**
+ * Check if an event is older than the configured max event age, and count
+ * it as dropped if it is.
+ *
+ * @param cfg       The config snapshot of the event.
+ * @param timestamp Time of the event in microseconds since the Unix epoch.
+ *
+ * @return TRUE if the event is stale, FALSE otherwise.
+ */
+static gboolean drop_stale_event(const config *cfg, gint64 timestamp);
+
+/**
+ * Pipeline encode stage, build the ACS command. Runs in parallel.
+ *
+ * @param data      The event_record to process.
+ * @param user_data Unused user data.
+ *
+ * @return FALSE if the event is stale, else TRUE, the overlay is updated
+ *         even if ACS is disabled.
+ */
+static gboolean encode_event_record(gpointer data, gpointer user_data);
+
+/**
+ * Pipeline send stage, push the command to ACS in event order.
+ *
+ * @param data      The event_record to process.
+ * @param user_data Unused user data.
+ *
+ * @return Always TRUE.
+ */
+static gboolean send_event_record(gpointer data, gpointer user_data);
+
+/**
+ * Pipeline display stage, update the overlay in event order.
+ *
+ * @param data      The event_record to process.
+ * @param user_data Unused user data.
+ *
+ * @return Always TRUE.
+ */
+static gboolean display_event_record(gpointer data, gpointer user_data);
+
+/**
+ * Show a sample of the performance counters in the overlay.
+ *
+ * @param user_data Unused user data.
+ *
+ * @return Always G_SOURCE_CONTINUE.
+ */
+static gboolean update_hud(gpointer user_data);
+
+/**
+ * Get the overlay of a channel, creating it if it is enabled and not
+ * created yet.
+ *
+ * @param channel The channel, 0 for the overlay on all channels.
+ *
+ * @return The overlay, NULL if disabled or not supported.
+ */
+static overlay_handle get_overlay(guint channel);
+
+/**
+ * Tear down the overlay of a channel, records in flight are no longer
+ * shown.
+ *
+ * @param channel The channel, 0 for the overlay on all channels.
+ *
+ * @return No return value.
+ */
+static void stop_overlay(guint channel);
+
+/**
+ * Tear down the overlays of all channels.
+ *
+ * @param first Lowest channel to tear down, 1 to keep the overlay on all
+ *              channels.
+ *
+ * @return No return value.
+ */
+static void stop_overlays(guint first);
+
+/**
+ * Set a channel parameter and publish it together with the channel map
+ * compiled from it.
+ *
+ * @param offset Offset of the string field in the config struct.
+ * @param value  The new value.
+ *
+ * @return No return value.
+ */
+static void update_channel_map(glong offset, const char *value);
+
+/**
+ * Take an event_record from the free records or allocate a new one.
+ *
+ * @return The record, all fields cleared.
+ */
+static event_record *new_event_record(void);
+
+/**
+ * Return an event_record to the free records.
+ *
+ * @param data The event_record to free.
+ *
+ * @return No return value.
+ */
+static void free_event_record(gpointer data);
+
+/**
+ * Deallocate all free event records.
+ *
+ * @return No return value.
+ */
+static void cleanup_event_records(void);
+
 /**
  * Subscribe to the Metadata event.
  *
- * @return Event ID handle for the subscription.
+ * @param analytic     The analytic to subscribe to.
+ * @param category     The category to subscribe to.
+ * @param generation   Generation passed as token to the event callback.
+ * @param subscription Return location for the subscription ID, 0 if no
+ *                     analytic is configured.
+ *
+ * @return TRUE on success, FALSE if the subscription failed.
+ */
+static gboolean metadata_event_subscribe(const gchar *analytic,
+                                         const gchar *category,
+                                         guint generation,
+                                         guint *subscription);
+
+/**
+ * Collect a subscription change, restarting the debounce timer.
+ *
+ * @return No return value.
+ */
+static void schedule_resubscribe(void);
+
+/**
+ * Validate and apply the collected subscription change. The new
+ * subscription is made before the old one is removed.
+ *
+ * @param user_data Unused user data.
+ *
+ * @return Always G_SOURCE_REMOVE.
+ */
+static gboolean apply_resubscribe(gpointer user_data);
+
+/**
+ * Check that a label can be used as event topic.
+ *
+ * @param label       The analytic or category.
+ * @param allow_empty TRUE if an empty label is allowed.
+ *
+ * @return TRUE if valid, FALSE otherwise.
  */
-static guint metadata_event_subscribe();
+static gboolean is_valid_topic(const gchar *label, gboolean allow_empty);
 
 /**
  * Quit the application when terminate signals is being sent.
@@ -204,6 +504,16 @@ static void handle_sigterm(int signo);
  */
 static void init_signals();
 
+/**
+ * Publish a new config snapshot with one string setting changed.
+ *
+ * @param offset Offset of the string field in the config struct.
+ * @param value  The new value, copied.
+ *
+ * @return No return value.
+ */
+static void set_config_string(glong offset, const char *value);
+
 /**
  * Callback function for changes to Server Address parameter.
  *
@@ -222,6 +532,24 @@ static void set_server_address(const char *value);
  */
 static void set_source_id(const char *value);
 
+/**
+ * Callback function for ChannelKey parameter.
+ *
+ * @param value The new key holding the channel number, " " for no channels.
+ *
+ * @return No return value.
+ */
+static void set_channel_key(const char *value);
+
+/**
+ * Callback function for ChannelSources parameter.
+ *
+ * @param value The new channel=source ID pairs.
+ *
+ * @return No return value.
+ */
+static void set_channel_sources(const char *value);
+
 /**
  * Callback function for changes to Username parameter
  * update ACS API credentials if needed.
@@ -287,6 +615,60 @@ static void set_items(const char *value);
  */
 static void set_filter(const char *value);
 
+/**
+ * Callback function for EncodeWorkers parameter.
+ *
+ * @param value The new number of encode threads, 0 for one per core.
+ *
+ * @return No return value.
+ */
+static void set_encode_workers(const char *value);
+
+/**
+ * Callback function for MaxEventAge parameter.
+ *
+ * @param value The new max event age in ms, 0 to disable.
+ *
+ * @return No return value.
+ */
+static void set_max_event_age(const char *value);
+
+/**
+ * Callback function for OverlayPalette parameter.
+ *
+ * @param value "yes" to draw the overlay in the 4-bit palette colorspace.
+ *
+ * @return No return value.
+ */
+static void set_overlay_palette(const char *value);
+
+/**
+ * Callback function for OverlayEnabled parameter.
+ *
+ * @param value "yes" to show the overlay, "no" to not set it up at all.
+ *
+ * @return No return value.
+ */
+static void set_overlay_enabled(const char *value);
+
+/**
+ * Callback function for IngestSocket parameter.
+ *
+ * @param value The new socket path, " " to disable.
+ *
+ * @return No return value.
+ */
+static void set_ingest_socket(const char *value);
+
+/**
+ * Callback function for OverlayHud parameter.
+ *
+ * @param value "yes" to show performance counters instead of the items.
+ *
+ * @return No return value.
+ */
+static void set_overlay_hud(const char *value);
+
 /**
  * Callback function debug enabled parameter. This is used to dynamically
  * enable / disable extra debug printing.
@@ -309,90 +691,417 @@ static void cgi_test_reporting(CAMERA_HTTP_Reply http,
                                CAMERA_HTTP_Options options);
 
 /**
- * CGI function for getting all parameters at once.
- *
- * @param http    HTTP_Reply object to use for sending response.
- * @param options Unused HTTP options parameter required by API.
- *
- * @return No return value.
+ * CGI function for getting all parameters at once.
+ *
+ * @param http    HTTP_Reply object to use for sending response.
+ * @param options Unused HTTP options parameter required by API.
+ *
+ * @return No return value.
+ */
+static void cgi_settings_get(CAMERA_HTTP_Reply http,
+                             CAMERA_HTTP_Options options);
+
+/**
+ * Content filter lookup function getting values from an event.
+ *
+ * @param key       Name of the key to look up.
+ * @param value     Return location for the value, type holds type hint.
+ * @param user_data The AXEventKeyValueSet of the event.
+ *
+ * @return TRUE if the key was found, FALSE otherwise.
+ */
+static gboolean lookup_event_value(const char *key,
+                                   content_filter_value *value,
+                                   gpointer user_data);
+
+/******************** LOCAL FUNCTION DEFINTION SECTION ************************/
+
+/**
+ * Callback Function for Metadata events. Runs in the GMainLoop so only
+ * filter and extract the items here and leave the rest to the pipeline.
+ */
+static void metadata_event_callback(guint subscription,
+    AXEvent *event, guint *token)
+{
+    if (event == NULL) {
+        return;
+    }
+
+    /* Already dispatched events from a subscription that was replaced */
+    if (GPOINTER_TO_UINT(token) != subscription_generation) {
+        DBG_LOG("Ignore event from old subscription %u", subscription);
+        goto cleanup;
+    }
+
+    const AXEventKeyValueSet *key_value_set = ax_event_get_key_value_set(event);
+
+    if (key_value_set == NULL) {
+        goto cleanup;
+    }
+
+    /* Time stamp is owned by the event, fall back to now if missing */
+    GDateTime *time_stamp = ax_event_get_time_stamp2(event);
+    gint64 timestamp      = g_get_real_time();
+
+    if (time_stamp != NULL) {
+        timestamp = g_date_time_to_unix(time_stamp) * G_USEC_PER_SEC +
+            g_date_time_get_microsecond(time_stamp);
+    }
+
+    DBG_LOG("Got event %s/%s event to push to ACS", sub_analytic,
+        sub_category);
+
+    submit_record(lookup_event_value, (gpointer) key_value_set, timestamp);
+
+cleanup:
+    /* Free the event as specified in SDK Documentation. */
+    ax_event_free(event);
+}
+
+/**
+ * Callback Function for ingested records. Records carry no time stamp of
+ * their own, they are pushed as they happen.
+ */
+static void ingest_record_callback(const ingest_message *message,
+                                   gpointer user_data)
+{
+    (void) user_data;
+
+    submit_record(ingest_lookup, (gpointer) message, g_get_real_time());
+}
+
+/**
+ * Filter and extract a record in the GMainLoop, leave the rest to the
+ * pipeline.
+ */
+static void submit_record(content_filter_lookup lookup,
+                          gpointer user_data,
+                          gint64 timestamp)
+{
+    mdp_record *metadata_items = NULL;
+    const config *cfg          = config_get();
+
+    /* Delivered late, skip all work */
+    if (drop_stale_event(cfg, timestamp)) {
+        return;
+    }
+
+    /* Reject before doing any extraction work */
+    if (!content_filter_match(cfg->content_filter, lookup, user_data)) {
+        DBG_LOG("Event rejected by content filter");
+        return;
+    }
+
+    if (!item_plan_extract(cfg->item_plan, lookup, user_data,
+        &metadata_items)) {
+        LOG("Failed to get metadata items");
+        return;
+    }
+
+    event_record *record = new_event_record();
+
+    /* Interned labels stay valid even if the parameters change */
+    record->items     = metadata_items;
+    record->config    = config_ref(cfg);
+    record->timestamp = timestamp;
+    record->analytic  = sub_analytic;
+    record->category  = sub_category;
+    record->channel   = channel_map_resolve(cfg->channel_map, lookup,
+        user_data, &record->source);
+
+    hud_count_event(hud);
+
+    /* The overlay is set up on the first record to show */
+    if (!config_get()->overlay_hud && record->analytic != NULL) {
+        (void) get_overlay(record->channel);
+    }
+
+    if (event_pipeline == NULL) {
+        /* No pipeline threads, fall back to processing in the GMainLoop */
+        encode_event_record(record, NULL);
+        send_event_record(record, NULL);
+        display_event_record(record, NULL);
+        free_event_record(record);
+    } else {
+        /* Record is dropped and freed by the pipeline if it is full */
+        (void) pipeline_push(event_pipeline, record);
+    }
+}
+
+/**
+ * Pipeline encode stage, build the ACS command.
+ */
+static gboolean encode_event_record(gpointer data, gpointer user_data)
+{
+    event_record *record = data;
+
+    (void) user_data;
+
+    /* Waited too long in the pipeline, skip encode, send and display */
+    if (drop_stale_event(record->config, record->timestamp)) {
+        return FALSE;
+    }
+
+    /* Fails when reporting is disabled, nothing is sent then */
+    record->encoded = acs_encode(record->config, record->source,
+        record->items, record->timestamp, record->command);
+
+    return TRUE;
+}
+
+/**
+ * Check the age of an event against the max event age.
+ */
+static gboolean drop_stale_event(const config *cfg, gint64 timestamp)
+{
+    if (cfg->max_event_age == 0) {
+        return FALSE;
+    }
+
+    gint64 age = g_get_real_time() - timestamp;
+
+    if (age <= (gint64) cfg->max_event_age * 1000) {
+        return FALSE;
+    }
+
+    gint dropped = g_atomic_int_add(&stale_events, 1) + 1;
+
+    DBG_LOG("Dropped event %" G_GINT64_FORMAT " ms old, %d stale in total",
+        age / 1000, dropped);
+
+    return TRUE;
+}
+
+/**
+ * Pipeline send stage, trigger sending of metadata.
+ */
+static gboolean send_event_record(gpointer data, gpointer user_data)
+{
+    event_record *record = data;
+
+    (void) user_data;
+
+    if (record->encoded) {
+        (void) acs_send(record->command->str, NULL);
+
+        if (record->config->overlay_hud) {
+            hud_add_latency(hud, g_get_real_time() - record->timestamp);
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * Pipeline display stage, show the metadata in the overlay.
+ */
+static gboolean display_event_record(gpointer data, gpointer user_data)
+{
+    event_record *record = data;
+
+    (void) user_data;
+
+    /* The HUD owns the overlay, ingested records may come without labels */
+    if (record->config->overlay_hud || record->analytic == NULL) {
+        return TRUE;
+    }
+
+    g_mutex_lock(&overlay_mutex);
+
+    overlay_set_data(ovl_handles[record->channel], record->items, 3000,
+        record->analytic, record->category);
+
+    g_mutex_unlock(&overlay_mutex);
+
+    return TRUE;
+}
+
+/**
+ * Sample the counters at the HUD rate, the rest of the time the HUD costs
+ * a counter increment per event.
+ */
+static gboolean update_hud(gpointer user_data)
+{
+    (void) user_data;
+
+    mdp_record *sample = hud_sample(hud,
+        pipeline_get_depth(event_pipeline),
+        pipeline_get_dropped(event_pipeline),
+        (guint) g_atomic_int_get(&stale_events));
+
+    overlay_set_data(get_overlay(0), sample, 0,
+        g_intern_static_string("Performance"), "");
+
+    mdp_record_unref(&sample);
+
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * Create the overlay on first use, on the camera of the channel. Only the
+ * GMainLoop changes the handles so they are read here without the mutex.
+ */
+static overlay_handle get_overlay(guint channel)
+{
+    if (ovl_handles[channel] != NULL || overlay_failed ||
+        !config_get()->overlay_enabled) {
+        return ovl_handles[channel];
+    }
+
+    overlay_handle handle = overlay_init(channel);
+
+    if (handle == NULL) {
+        ERR("Failed to create overlay, not retried until re-enabled");
+        overlay_failed = TRUE;
+        return NULL;
+    }
+
+    /* The overlay starts out in ARGB32 */
+    if (config_get()->overlay_palette) {
+        overlay_set_palette(handle, TRUE);
+    }
+
+    g_mutex_lock(&overlay_mutex);
+    ovl_handles[channel] = handle;
+    g_mutex_unlock(&overlay_mutex);
+
+    LOG("Overlay created for channel %u", channel);
+
+    return handle;
+}
+
+/**
+ * Detach the overlay from the display stage before destroying it.
+ */
+static void stop_overlay(guint channel)
+{
+    g_mutex_lock(&overlay_mutex);
+
+    overlay_handle handle = ovl_handles[channel];
+    ovl_handles[channel]  = NULL;
+
+    g_mutex_unlock(&overlay_mutex);
+
+    overlay_cleanup(&handle);
+}
+
+/**
+ * Tear down the overlays of all channels from first and up.
  */
-static void cgi_settings_get(CAMERA_HTTP_Reply http,
-                             CAMERA_HTTP_Options options);
+static void stop_overlays(guint first)
+{
+    guint channel = first;
+    for (; channel <= MAX_CHANNELS; channel++) {
+        stop_overlay(channel);
+    }
+}
 
 /**
- * Build a key-value par list of metadata items that can then be sent
- * to the different reporting tools like ACS and overlay. Uses the items
- * parameter to determine what items to get.
- *
- * @param key_value_set The set from which to get the item values
- * @param list Return location for the list of mdp_item_pair
- *
- * @return No return value.
+ * Compile the channel map. The overlays of the old channels are removed,
+ * they are created again on the first record of each channel.
  */
-static gboolean build_metadata_items(const AXEventKeyValueSet *key_value_set,
-                                     GList **list);
+static void update_channel_map(glong offset, const char *value)
+{
+    config *cfg   = config_edit();
+    gchar **field = G_STRUCT_MEMBER_P(cfg, offset);
+    gchar *error  = NULL;
 
-/******************** LOCAL FUNCTION DEFINTION SECTION ************************/
+    g_free(*field);
+    *field = g_strdup(value);
+
+    channel_map_cleanup(&cfg->channel_map);
+    cfg->channel_map = channel_map_init(cfg->channel_key,
+        cfg->channel_sources, &error);
+
+    config_publish(cfg);
+
+    if (error != NULL) {
+        ERR("Invalid channel sources, channels not used: %s", error);
+        g_free(error);
+    }
+
+    stop_overlays(1);
+}
 
 /**
- * Callback Function for Metadata events. Avoid blocking here so
- * use async setting when sending data to ACS.
+ * Take an event_record from the free records or allocate a new one.
  */
-static void metadata_event_callback(guint subscription,
-    AXEvent *event, guint *token)
+static event_record *new_event_record(void)
 {
-    (void) token;
+    g_mutex_lock(&record_mutex);
 
-    if (event == NULL) {
-        return;
+    event_record *record = free_records;
+
+    if (record != NULL) {
+        free_records = record->next;
     }
 
-    const AXEventKeyValueSet *key_value_set = ax_event_get_key_value_set(event);
+    g_mutex_unlock(&record_mutex);
 
-    if (key_value_set == NULL) {
-        goto cleanup;
+    if (record == NULL) {
+        record          = g_new0(event_record, 1);
+        record->command = g_string_new(NULL);
     }
 
-    DBG_LOG("Got event %s/%s event to push to ACS", par_analytic,
-        par_category);
+    record->next    = NULL;
+    record->encoded = FALSE;
 
-    GList *metadata_items = NULL;
-    gboolean ret = build_metadata_items(key_value_set, &metadata_items);
+    return record;
+}
 
-    if (ret == FALSE) {
-        LOG("Failed to get metadata items");
-        goto cleanup;
-    }
+/**
+ * Return an event_record to the free records. The number of records is
+ * bounded by the pipeline capacity so the free records are not capped.
+ */
+static void free_event_record(gpointer data)
+{
+    event_record *record = data;
 
-    /**
-     * Trigger sending of metadata.
-     */
-    (void) acs_run(acs, metadata_items, NULL);
+    mdp_record_unref(&record->items);
+    config_unref(&record->config);
 
-    overlay_set_data(ovl_handle, metadata_items, 3000,
-        par_analytic, par_category);
+    g_mutex_lock(&record_mutex);
 
-cleanup:
-    if (metadata_items != NULL) {
-        mdp_destroy_list(&cur_metadata_items);
-        cur_metadata_items = metadata_items;
+    record->next = free_records;
+    free_records = record;
+
+    g_mutex_unlock(&record_mutex);
+}
+
+/**
+ * Deallocate all free event records.
+ */
+static void cleanup_event_records(void)
+{
+    g_mutex_lock(&record_mutex);
+
+    while (free_records != NULL) {
+        event_record *record = free_records;
+        free_records = record->next;
+
+        g_string_free(record->command, TRUE);
+        g_free(record);
     }
-    /* Free the event as specified in SDK Documentation. */
-    ax_event_free(event);
+
+    g_mutex_unlock(&record_mutex);
 }
 
 /**
  * Subscribe to the specified event.
  */
-static guint metadata_event_subscribe()
+static gboolean metadata_event_subscribe(const gchar *analytic,
+                                         const gchar *category,
+                                         guint generation,
+                                         guint *subscription)
 {
     AXEventKeyValueSet *key_value_set;
-    guint subscription;
     gboolean result;
 
-    if (g_strcmp0(par_analytic, " ") == 0) {
+    *subscription = 0;
+
+    if (g_strcmp0(analytic, " ") == 0) {
         DBG_LOG("No analytic configured, skip event subscription");
-        return 0;
+        return TRUE;
     }
 
     key_value_set = ax_event_key_value_set_new();
@@ -407,13 +1116,13 @@ static guint metadata_event_subscribe()
         NULL);
 
     ax_event_key_value_set_add_key_value(key_value_set,
-        "topic1", NULL, par_analytic, AX_VALUE_TYPE_STRING,
+        "topic1", NULL, analytic, AX_VALUE_TYPE_STRING,
         NULL);
 
-    if (g_strcmp0(par_category, "") != 0 &&
-        g_strcmp0(par_category, "Uncategorized") != 0) {
+    if (g_strcmp0(category, "") != 0 &&
+        g_strcmp0(category, "Uncategorized") != 0) {
         ax_event_key_value_set_add_key_value(key_value_set,
-        "topic2", NULL, par_category, AX_VALUE_TYPE_STRING,
+        "topic2", NULL, category, AX_VALUE_TYPE_STRING,
         NULL);
     } else {
         DBG_LOG("NOT Adding Uncategorized");
@@ -423,8 +1132,8 @@ static guint metadata_event_subscribe()
     * input data to the callback function "subscription callback"
     */
     result = ax_event_handler_subscribe(event_handler, key_value_set,
-        &subscription, (AXSubscriptionCallback)metadata_event_callback, NULL,
-        NULL);
+        subscription, (AXSubscriptionCallback)metadata_event_callback,
+        GUINT_TO_POINTER(generation), NULL);
 
     if (!result) {
         ERR("Failed to subscribe to event");
@@ -435,7 +1144,103 @@ static guint metadata_event_subscribe()
     /* The key/value set is no longer needed */
     ax_event_key_value_set_free(key_value_set);
 
-    return subscription;
+    return result;
+}
+
+/**
+ * Collect a subscription change, every new change restarts the timer so
+ * a burst of parameter saves is applied once.
+ */
+static void schedule_resubscribe(void)
+{
+    if (resubscribe_timer != 0) {
+        g_source_remove(resubscribe_timer);
+    }
+
+    resubscribe_timer = g_timeout_add(RESUBSCRIBE_DELAY, apply_resubscribe,
+        NULL);
+}
+
+/**
+ * Validate and apply the collected subscription change. An invalid change
+ * or a failed subscribe leaves the current subscription untouched. Making
+ * the new subscription first means no events are lost in between.
+ */
+static gboolean apply_resubscribe(gpointer user_data)
+{
+    (void) user_data;
+
+    resubscribe_timer = 0;
+
+    const config *cfg = config_get();
+
+    /* Labels are interned so unchanged labels have the same pointer */
+    if (cfg->analytic == sub_analytic && cfg->category == sub_category) {
+        DBG_LOG("Subscription unchanged");
+        return G_SOURCE_REMOVE;
+    }
+
+    if (!is_valid_topic(cfg->analytic, FALSE) ||
+        !is_valid_topic(cfg->category, TRUE)) {
+        ERR("Invalid Analytic '%s' or Category '%s', keep subscription",
+            cfg->analytic, cfg->category);
+        return G_SOURCE_REMOVE;
+    }
+
+    LOG("Subscription change %s/%s -> %s/%s", sub_analytic, sub_category,
+        cfg->analytic, cfg->category);
+
+    guint generation   = subscription_generation + 1;
+    guint subscription = 0;
+
+    if (!metadata_event_subscribe(cfg->analytic, cfg->category, generation,
+        &subscription)) {
+        ERR("Failed to change subscription, keep %s/%s", sub_analytic,
+            sub_category);
+        return G_SOURCE_REMOVE;
+    }
+
+    /* New subscription is live, route events to it and retire the old */
+    guint old_subscription = event_subscription_id;
+
+    event_subscription_id   = subscription;
+    subscription_generation = generation;
+    sub_analytic            = cfg->analytic;
+    sub_category            = cfg->category;
+
+    if (old_subscription != 0) {
+        ax_event_handler_unsubscribe(event_handler, old_subscription, NULL);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Check that a label can be used as event topic. A single space is how
+ * the web UI stores an unset value and is accepted.
+ */
+static gboolean is_valid_topic(const gchar *label, gboolean allow_empty)
+{
+    if (label == NULL) {
+        return FALSE;
+    }
+
+    if (*label == '\0') {
+        return allow_empty;
+    }
+
+    if (g_strcmp0(label, " ") == 0) {
+        return TRUE;
+    }
+
+    const gchar *c = label;
+    for (; *c != '\0'; c++) {
+        if (g_ascii_isspace(*c) || *c == '/') {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
 }
 
 /**
@@ -465,13 +1270,27 @@ static void init_signals()
 }
 
 /**
- * Callback function for changes to ServerAddress parameter
+ * Publish a new config with one string setting changed.
+ */
+static void set_config_string(glong offset, const char *value)
+{
+    config *cfg   = config_edit();
+    gchar **field = G_STRUCT_MEMBER_P(cfg, offset);
+
+    g_free(*field);
+    *field = g_strdup(value);
+
+    config_publish(cfg);
+}
+
+/**
+ * Callback function for changes to Server Address parameter
  * update ACS API settings.
  */
 static void set_server_address(const char *value)
 {
     DBG_LOG("Got new Server Address %s", value);
-    acs_set_ipname(acs, value);
+    set_config_string(G_STRUCT_OFFSET(config, ipname), value);
 }
 
 /**
@@ -481,7 +1300,35 @@ static void set_server_address(const char *value)
 static void set_source_id(const char *value)
 {
     DBG_LOG("Got new Source ID %s", value);
-    acs_set_source(acs, value);
+    set_config_string(G_STRUCT_OFFSET(config, source), value);
+}
+
+/**
+ * Callback function for changes to ChannelKey parameter.
+ */
+static void set_channel_key(const char *value)
+{
+    DBG_LOG("Got new ChannelKey %s", value);
+
+    if (g_strcmp0(value, config_get()->channel_key) == 0) {
+        return;
+    }
+
+    update_channel_map(G_STRUCT_OFFSET(config, channel_key), value);
+}
+
+/**
+ * Callback function for changes to ChannelSources parameter.
+ */
+static void set_channel_sources(const char *value)
+{
+    DBG_LOG("Got new ChannelSources %s", value);
+
+    if (g_strcmp0(value, config_get()->channel_sources) == 0) {
+        return;
+    }
+
+    update_channel_map(G_STRUCT_OFFSET(config, channel_sources), value);
 }
 
 /**
@@ -491,7 +1338,7 @@ static void set_source_id(const char *value)
 static void set_username(const char *value)
 {
     DBG_LOG("Got new Username %s", value);
-    acs_set_username(acs, value);
+    set_config_string(G_STRUCT_OFFSET(config, username), value);
 }
 
 /**
@@ -501,7 +1348,7 @@ static void set_username(const char *value)
 static void set_password(const char *value)
 {
     DBG_LOG("Got new Password %s", value);
-    acs_set_password(acs, value);
+    set_config_string(G_STRUCT_OFFSET(config, password), value);
 }
 
 /**
@@ -510,42 +1357,40 @@ static void set_password(const char *value)
 static void set_enabled(const char *value)
 {
     DBG_LOG("Got new Enabled %s", value);
-    acs_set_enabled(acs, value);
+    set_config_string(G_STRUCT_OFFSET(config, enabled), value);
 }
 
 /**
- * Callback function for Analytic parameter. Update event subscription
- * if needed.
+ * Callback function for Analytic parameter. Collect the change for the
+ * next subscription update.
  */
 static void set_analytic(const char *value)
 {
-    if (g_strcmp0(value, par_analytic) != 0) {
+    if (g_strcmp0(value, config_get()->analytic) != 0) {
         DBG_LOG("Got new Analytic %s", value);
-        g_free(par_analytic);
-        par_analytic = g_strdup(value);
 
-        ax_event_handler_unsubscribe(event_handler,
-            event_subscription_id, NULL);
+        config *cfg   = config_edit();
+        cfg->analytic = g_intern_string(value);
+        config_publish(cfg);
 
-        event_subscription_id = metadata_event_subscribe();
+        schedule_resubscribe();
     }
 }
 
 /**
- * Callback function for Category parameter. Update event subscription
- * if needed.
+ * Callback function for Category parameter. Collect the change for the
+ * next subscription update.
  */
 static void set_category(const char *value)
 {
-    if (g_strcmp0(value, par_category) != 0) {
+    if (g_strcmp0(value, config_get()->category) != 0) {
         DBG_LOG("Got new Category %s", value);
-        g_free(par_category);
-        par_category = g_strdup(value);
 
-        ax_event_handler_unsubscribe(event_handler,
-            event_subscription_id, NULL);
+        config *cfg   = config_edit();
+        cfg->category = g_intern_string(value);
+        config_publish(cfg);
 
-        event_subscription_id = metadata_event_subscribe();
+        schedule_resubscribe();
     }
 }
 
@@ -556,8 +1401,17 @@ static void set_category(const char *value)
 static void set_items(const char *value)
 {
     DBG_LOG("Got new Items %s", value);
-    g_free(par_items);
-    par_items = g_strdup(value);
+
+    /* The plan is published in the same snapshot as the Items it is from */
+    config *cfg = config_edit();
+
+    g_free(cfg->items);
+    cfg->items = g_strdup(value);
+
+    item_plan_cleanup(&cfg->item_plan);
+    cfg->item_plan = item_plan_init(cfg->items);
+
+    config_publish(cfg);
 }
 
 /**
@@ -567,8 +1421,147 @@ static void set_items(const char *value)
 static void set_filter(const char *value)
 {
     DBG_LOG("Got new Filter %s", value);
-    g_free(par_filter);
-    par_filter = g_strdup(value);
+    gchar *error = NULL;
+    config *cfg  = config_edit();
+
+    g_free(cfg->filter);
+    cfg->filter = g_strdup(value);
+
+    content_filter_cleanup(&cfg->content_filter);
+    cfg->content_filter = content_filter_init(cfg->filter, &error);
+
+    config_publish(cfg);
+
+    if (error != NULL) {
+        ERR("Invalid content filter %s: %s", value, error);
+        g_free(error);
+    }
+}
+
+/**
+ * Callback function for EncodeWorkers parameter.
+ */
+static void set_encode_workers(const char *value)
+{
+    guint workers = (guint) g_ascii_strtoull(value, NULL, 10);
+
+    config *cfg         = config_edit();
+    cfg->encode_workers = workers;
+    config_publish(cfg);
+
+    if (workers == 0) {
+        workers = g_get_num_processors();
+    }
+
+    DBG_LOG("Got new EncodeWorkers %s, using %u threads", value, workers);
+    pipeline_set_concurrency(event_pipeline, STAGE_ENCODE, workers);
+}
+
+/**
+ * Callback function for MaxEventAge parameter.
+ */
+static void set_max_event_age(const char *value)
+{
+    DBG_LOG("Got new MaxEventAge %s", value);
+
+    config *cfg        = config_edit();
+    cfg->max_event_age = (guint) g_ascii_strtoull(value, NULL, 10);
+    config_publish(cfg);
+}
+
+/**
+ * Callback function for OverlayPalette parameter.
+ */
+static void set_overlay_palette(const char *value)
+{
+    DBG_LOG("Got new OverlayPalette %s", value);
+
+    config *cfg          = config_edit();
+    cfg->overlay_palette = g_strcmp0(value, "yes") == 0;
+    config_publish(cfg);
+
+    guint channel = 0;
+    for (; channel <= MAX_CHANNELS; channel++) {
+        overlay_set_palette(ovl_handles[channel],
+            config_get()->overlay_palette);
+    }
+}
+
+/**
+ * Callback function for OverlayEnabled parameter. Switching on does not
+ * create the overlay, that is left to the first record or HUD update.
+ */
+static void set_overlay_enabled(const char *value)
+{
+    DBG_LOG("Got new OverlayEnabled %s", value);
+
+    config *cfg          = config_edit();
+    cfg->overlay_enabled = g_strcmp0(value, "yes") == 0;
+    config_publish(cfg);
+
+    if (config_get()->overlay_enabled) {
+        overlay_failed = FALSE;
+    } else {
+        stop_overlays(0);
+    }
+}
+
+/**
+ * Callback function for IngestSocket parameter, recreate the endpoint on
+ * the new path.
+ */
+static void set_ingest_socket(const char *value)
+{
+    DBG_LOG("Got new IngestSocket %s", value);
+    gchar *error = NULL;
+
+    if (g_strcmp0(value, config_get()->ingest_socket) == 0) {
+        return;
+    }
+
+    set_config_string(G_STRUCT_OFFSET(config, ingest_socket), value);
+
+    ingest_cleanup(&ingest);
+
+    gchar *path = g_strstrip(g_strdup(value));
+
+    if (*path != '\0') {
+        ingest = ingest_init(path, ingest_record_callback, NULL, &error);
+
+        if (ingest == NULL) {
+            ERR("Failed to start ingest socket: %s", error);
+            g_free(error);
+        }
+    }
+
+    g_free(path);
+}
+
+/**
+ * Callback function for OverlayHud parameter, start or stop the HUD timer.
+ */
+static void set_overlay_hud(const char *value)
+{
+    DBG_LOG("Got new OverlayHud %s", value);
+
+    config *cfg      = config_edit();
+    cfg->overlay_hud = g_strcmp0(value, "yes") == 0;
+    config_publish(cfg);
+
+    if (config_get()->overlay_hud && hud_timer == 0) {
+        hud_reset(hud);
+        hud_timer = g_timeout_add(HUD_INTERVAL, update_hud, NULL);
+    } else if (!config_get()->overlay_hud && hud_timer != 0) {
+        g_source_remove(hud_timer);
+        hud_timer = 0;
+
+        /**
+         * The HUD is on the overlay of all channels, remove it so it does
+         * not cover the overlays of the channels. It is created again for
+         * the next record without a channel.
+         */
+        stop_overlay(0);
+    }
 }
 
 /**
@@ -577,13 +1570,12 @@ static void set_filter(const char *value)
  */
 static void set_debug_enabled(const char *value)
 {
-    if (g_strcmp0(value, par_debug_enabled) != 0) {
-        g_free(par_debug_enabled);
-        par_debug_enabled = g_strdup(value);
+    if (g_strcmp0(value, config_get()->debug_enabled) != 0) {
+        set_config_string(G_STRUCT_OFFSET(config, debug_enabled), value);
 
-        DBG_LOG("Got new DebugEnabled %s", par_debug_enabled);
+        DBG_LOG("Got new DebugEnabled %s", value);
 
-        if (g_strcmp0(par_debug_enabled, "yes") == 0) {
+        if (g_strcmp0(value, "yes") == 0) {
             set_debug(TRUE);
             DBG_LOG("Enabled debug logging");
         } else {
@@ -603,40 +1595,42 @@ static void cgi_test_reporting(CAMERA_HTTP_Reply http,
 {
     gchar *error  = NULL;
     gchar *result = NULL;
-    GList *metadata_items = NULL;
+    mdp_record *metadata_items = NULL;
+    const config *cfg          = config_get();
 
-    if (g_strcmp0(par_analytic, " ") == 0) {
+    if (g_strcmp0(cfg->analytic, " ") == 0) {
         result = g_strdup("Error");
         error  = g_strdup("Save Analytic");
         goto send_xml;
     }
 
-    if (g_strcmp0(par_category, " ") == 0) {
+    if (g_strcmp0(cfg->category, " ") == 0) {
         result = g_strdup("Error");
         error  = g_strdup("Save Category");
         goto send_xml;
     }
 
-    if (g_strcmp0(par_items, " ") == 0) {
+    if (g_strcmp0(cfg->items, " ") == 0) {
         result = g_strdup("Error");
         error  = g_strdup("Save Items");
         goto send_xml;
     }
 
-    if (g_strcmp0(acs_get_enabled(acs), "yes") != 0) {
+    if (g_strcmp0(cfg->enabled, "yes") != 0) {
         result = g_strdup("Error");
         error  = g_strdup("Enable reporting");
         goto send_xml;
     }
 
-    gboolean ret = build_metadata_items(NULL, &metadata_items);
+    gboolean ret = item_plan_extract(cfg->item_plan, NULL, NULL,
+        &metadata_items);
 
     if (ret == FALSE) {
         result = g_strdup("Item Error");
         goto send_xml;
     }
 
-    ret = acs_run(acs, metadata_items, &error);
+    ret = acs_run(cfg, metadata_items, &error);
 
     if (ret == FALSE) {
         result = g_strdup("Failure");
@@ -655,7 +1649,7 @@ send_xml:
     error);
     camera_http_output(http, "</settings>");
 
-    mdp_destroy_list(&metadata_items);
+    mdp_record_unref(&metadata_items);
     g_free(error);
     g_free(result);
 }
@@ -666,24 +1660,26 @@ send_xml:
 static void cgi_settings_get(CAMERA_HTTP_Reply http,
                              CAMERA_HTTP_Options options)
 {
+  const config *cfg = config_get();
+
   gchar *server_address_encode =
-    g_uri_escape_string(acs_get_ipname(acs), NULL, FALSE);
+    g_uri_escape_string(cfg->ipname, NULL, FALSE);
   gchar *source_id_encode      =
-    g_uri_escape_string(acs_get_source(acs), NULL, FALSE);
+    g_uri_escape_string(cfg->source, NULL, FALSE);
   gchar *username_encode       =
-    g_uri_escape_string(acs_get_username(acs), NULL, FALSE);
+    g_uri_escape_string(cfg->username, NULL, FALSE);
   gchar *password_encode       =
-    g_uri_escape_string(acs_get_password(acs), NULL, FALSE);
+    g_uri_escape_string(cfg->password, NULL, FALSE);
   gchar *enabled_encode        =
-    g_uri_escape_string(acs_get_enabled(acs), NULL, FALSE);
+    g_uri_escape_string(cfg->enabled, NULL, FALSE);
   gchar *analytic_encode       =
-    g_uri_escape_string(par_analytic, NULL, FALSE);
+    g_uri_escape_string(cfg->analytic, NULL, FALSE);
   gchar *category_encode       =
-    g_uri_escape_string(par_category, NULL, FALSE);
+    g_uri_escape_string(cfg->category, NULL, FALSE);
   gchar *items_encode          =
-    g_uri_escape_string(par_items, NULL, FALSE);
+    g_uri_escape_string(cfg->items, NULL, FALSE);
   gchar *debug_encode          =
-    g_uri_escape_string(par_debug_enabled, NULL, FALSE);
+    g_uri_escape_string(cfg->debug_enabled, NULL, FALSE);
 
   camera_http_sendXMLheader(http);
   camera_http_output(http, "<settings>");
@@ -719,130 +1715,61 @@ static void cgi_settings_get(CAMERA_HTTP_Reply http,
 }
 
 /**
- * Build list of key-value pairs with metadata info.
+ * Content filter lookup function getting values from an event. Try the type
+ * the key had last time first to keep it at one lookup in the common case.
  */
-static gboolean build_metadata_items(const AXEventKeyValueSet *key_value_set,
-                                     GList **list)
+static gboolean lookup_event_value(const char *key,
+                                   content_filter_value *value,
+                                   gpointer user_data)
 {
-    g_assert(list);
-
-    /* Get list of current selected data items to send to ACS */
-    gchar **data_items     = g_strsplit(par_items, ";", MAX_ITEMS);
-    GList *metadata_items  = NULL;
-    gboolean ret           = TRUE;
-
-    gchar *filter_key      = NULL;
-    gchar *filter_value    = NULL;
-    gboolean content_match = TRUE;
-
-    /* Get content filter key, value */
-    if (g_strcmp0(par_filter, " ") != 0) {
-        content_match = FALSE;
-
-        gchar **filter_items = g_strsplit(par_filter, "=", 2);
+    const AXEventKeyValueSet *key_value_set = user_data;
+    content_filter_type type = value->type;
+    int i = 0;
 
-        if (filter_items[0] != NULL && filter_items[1] != NULL &&
-            filter_items[2] == NULL) {
-            filter_key   = g_strdup(filter_items[0]);
-            filter_value = g_strdup(filter_items[1]);
+    for (; i <= CONTENT_FILTER_TYPE_DOUBLE; i++) {
+        /* First round uses the hint, then probe the remaining types */
+        if (i > 0) {
+            if ((content_filter_type) i == value->type) {
+                continue;
+            }
+            type = i;
         }
 
-        g_strfreev(filter_items);
-    }
-
-    int i = 0;
-    for (; i < MAX_ITEMS; i++) {
-        if (data_items[i] != NULL && g_strcmp0(data_items[i], "") != 0) {
-            /**
-             * Get corresponding value from key value set.
-             * Simplify webcode by just looping over all possible data types
-             */
-            gchar    *item_value = NULL;
-            gboolean found_item  = FALSE;
-            gboolean item_value_boolean;
-            gint     item_value_int;
-            gdouble  item_value_double;
-
-            if (key_value_set == NULL) {
-                found_item = TRUE;
-                item_value = g_strdup("TEST");
-            } else if (ax_event_key_value_set_get_string(key_value_set,
-                data_items[i], NULL, &item_value, NULL)) {
-                found_item = TRUE;
-            } else if (ax_event_key_value_set_get_boolean(key_value_set,
-                    data_items[i], NULL, &item_value_boolean, NULL)) {
-
-                if (item_value_boolean == TRUE) {
-                    item_value = g_strdup("yes");
-                } else {
-                    item_value = g_strdup("no");
-                }
-
-                found_item = TRUE;
-            } else if (ax_event_key_value_set_get_integer(key_value_set,
-                    data_items[i], NULL, &item_value_int, NULL)) {
-                item_value = g_strdup_printf("%d", item_value_int);
-                found_item = TRUE;
-            } else if (ax_event_key_value_set_get_double(key_value_set,
-                    data_items[i], NULL, &item_value_double, NULL)) {
-                item_value = g_strdup_printf("%f", item_value_double);
-                found_item = TRUE;
+        switch (type) {
+        case CONTENT_FILTER_TYPE_STRING:
+            if (ax_event_key_value_set_get_string(key_value_set, key, NULL,
+                &value->string, NULL)) {
+                value->type = type;
+                return TRUE;
             }
-
-            /* Leave and clean up if couldn't find some of the data */
-            if (!found_item) {
-                ret = FALSE;
-                ERR("Failed to get %s information", data_items[0]);
-                g_free(item_value);
-                goto cleanup;
-            } else if (filter_key && filter_value) {
-                if (g_strcmp0(filter_key,   data_items[i]) == 0 &&
-                    g_strcmp0(filter_value, item_value) == 0) {
-                    content_match = TRUE;
-                }
+            break;
+        case CONTENT_FILTER_TYPE_BOOLEAN:
+            if (ax_event_key_value_set_get_boolean(key_value_set, key, NULL,
+                &value->boolean, NULL)) {
+                value->type = type;
+                return TRUE;
             }
-
-
-            /* Capitalize first character to make it look better in ACS */
-            data_items[i][0] = g_ascii_toupper(data_items[i][0]);
-
-            /* Create metadata pair and insert in list */
-            mdp_item_pair *item_pair = g_try_new0(mdp_item_pair, 1);
-
-            if (item_pair == NULL) {
-                ret = FALSE;
-                ERR("Failed to allocate metadata item");
-                g_free(item_value);
-                goto cleanup;
+            break;
+        case CONTENT_FILTER_TYPE_INTEGER:
+            if (ax_event_key_value_set_get_integer(key_value_set, key, NULL,
+                &value->integer, NULL)) {
+                value->type = type;
+                return TRUE;
             }
-
-            item_pair->name  = g_strdup(data_items[i]);
-            item_pair->value = g_strdup(item_value);
-
-            metadata_items   = g_list_append(metadata_items,
-                item_pair);
-
-            /* Item value is allocated by ax_event and is freed by caller */
-            g_free(item_value);
-        } else {
+            break;
+        case CONTENT_FILTER_TYPE_DOUBLE:
+            if (ax_event_key_value_set_get_double(key_value_set, key, NULL,
+                &value->number, NULL)) {
+                value->type = type;
+                return TRUE;
+            }
+            break;
+        default:
             break;
         }
     }
 
-cleanup:
-    g_strfreev(data_items);
-    g_free(filter_key);
-    g_free(filter_value);
-
-    if (ret == FALSE || content_match == FALSE) {
-        mdp_destroy_list(&metadata_items);
-        *list = NULL;
-        return FALSE;
-    }
-
-    *list = metadata_items;
-
-    return TRUE;
+    return FALSE;
 }
 
 /******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
@@ -865,89 +1792,101 @@ int main(int argc, char *argv[])
     init_signals();
 
 
-    loop       = g_main_loop_new(NULL, FALSE);
-    acs        = acs_init();
-    ovl_handle = overlay_init();
-
-    /* Create an AXEventHandler */
-    event_handler = ax_event_handler_new();
+    loop = g_main_loop_new(NULL, FALSE);
+    hud  = hud_init(HUD_INTERVAL);
 
-    char value[50];
+    /**
+     * Stages every event is run through. Encoding can run in any order,
+     * sending and display must follow the event order so they run one
+     * record at a time.
+     */
+    const pipeline_stage stages[NBR_OF_STAGES] = {
+        [STAGE_ENCODE]  = { "encode",  encode_event_record,  1, FALSE },
+        [STAGE_SEND]    = { "send",    send_event_record,    1, TRUE  },
+        [STAGE_DISPLAY] = { "display", display_event_record, 1, TRUE  },
+    };
 
-    if(camera_param_get("DebugEnabled", value, 50)) {
-        set_debug_enabled(value);
-    }
+    event_pipeline = pipeline_init(PIPELINE_CAPACITY, stages, NBR_OF_STAGES,
+        free_event_record, NULL);
 
-    if(camera_param_get("ServerAddress", value, 50)) {
-        set_server_address(value);
-    }
+    /* Create an AXEventHandler */
+    event_handler = ax_event_handler_new();
 
-    if(camera_param_get("SourceID", value, 50)) {
-        set_source_id(value);
+    /**
+     * Parameters are read in full, whatever their length, and the setters
+     * are then registered for changes. Debug is first to log the others.
+     */
+    const struct {
+        const char            *name;
+        CAMERA_PARAM_callback setter;
+    } params[] = {
+        { "DebugEnabled",   set_debug_enabled   },
+        { "ServerAddress",  set_server_address  },
+        { "SourceID",       set_source_id       },
+        { "ChannelKey",     set_channel_key     },
+        { "ChannelSources", set_channel_sources },
+        { "Username",       set_username        },
+        { "Password",       set_password        },
+        { "Enabled",        set_enabled         },
+        { "Analytic",       set_analytic        },
+        { "Category",       set_category        },
+        { "Items",          set_items           },
+        { "ContentFilter",  set_filter          },
+        { "EncodeWorkers",  set_encode_workers  },
+        { "MaxEventAge",    set_max_event_age   },
+        { "OverlayEnabled", set_overlay_enabled },
+        { "OverlayPalette", set_overlay_palette },
+        { "IngestSocket",   set_ingest_socket   },
+        { "OverlayHud",     set_overlay_hud     },
+    };
+
+    guint i = 0;
+    for (; i < G_N_ELEMENTS(params); i++) {
+        gchar *value = camera_param_dup(params[i].name);
+
+        if (value != NULL) {
+            params[i].setter(value);
+            g_free(value);
+        }
     }
 
-    if(camera_param_get("Username", value, 50)) {
-        set_username(value);
+    for (i = 0; i < G_N_ELEMENTS(params); i++) {
+        camera_param_setCallback(params[i].name, params[i].setter);
     }
 
-    if(camera_param_get("Password", value, 50)) {
-        set_password(value);
-    }
+    camera_http_setCallback("settings/testreporting", cgi_test_reporting);
+    camera_http_setCallback("settings/get", cgi_settings_get);
 
-    if(camera_param_get("Enabled", value, 50)) {
-        set_enabled(value);
-    }
+    g_main_loop_run(loop);
+    g_main_loop_unref(loop);
 
-    if(camera_param_get("Analytic", value, 50)) {
-        set_analytic(value);
-    }
+    loop = NULL;
 
-    if(camera_param_get("Category", value, 50)) {
-        set_category(value);
+    if (resubscribe_timer != 0) {
+        g_source_remove(resubscribe_timer);
     }
 
-    if(camera_param_get("Items", value, 300)) {
-        set_items(value);
+    if (hud_timer != 0) {
+        g_source_remove(hud_timer);
     }
 
-    if(camera_param_get("ContentFilter", value, 300)) {
-        set_filter(value);
+    if (event_subscription_id != 0) {
+        ax_event_handler_unsubscribe(event_handler, event_subscription_id,
+            NULL);
     }
 
-    camera_param_setCallback("ServerAddress", set_server_address);
-    camera_param_setCallback("SourceID",      set_source_id);
-    camera_param_setCallback("Username",      set_username);
-    camera_param_setCallback("Password",      set_password);
-    camera_param_setCallback("Enabled",       set_enabled);
-    camera_param_setCallback("Analytic",      set_analytic);
-    camera_param_setCallback("Category",      set_category);
-    camera_param_setCallback("Items",         set_items);
-    camera_param_setCallback("ContentFilter", set_filter);
-    camera_param_setCallback("DebugEnabled",  set_debug_enabled);
-
-    camera_http_setCallback("settings/testreporting", cgi_test_reporting);
-    camera_http_setCallback("settings/get", cgi_settings_get);
-
-    g_main_loop_run(loop);
-    g_main_loop_unref(loop);
-
-    loop = NULL;
-
-    ax_event_handler_unsubscribe(event_handler, event_subscription_id,
-        NULL);
+    ingest_cleanup(&ingest);
+    pipeline_cleanup(&event_pipeline);
+    hud_cleanup(&hud);
     camera_cleanup();
     closelog();
-    acs_cleanup(&acs);
-    overlay_cleanup(&ovl_handle);
-    mdp_destroy_list(&cur_metadata_items);
+    stop_overlays(0);
+    cleanup_event_records();
+    mdp_pool_cleanup();
 
     LOG("Exiting application");
 
-    g_free(par_analytic);
-    g_free(par_category);
-    g_free(par_items);
-    g_free(par_filter);
-    g_free(par_debug_enabled);
+    config_cleanup();
 
     /* TODO: This locks the program on termination for some reason.
     ax_event_handler_free(event_handler);
@@ -6,61 +6,424 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "metadata_pair.h"
 #include "debug.h"
 
 /** @file metadata_pair.c
- * @Brief Implementation file meta data pair and lists.
+ * @Brief Implementation file for arena allocated metadata records.
  *
+ * Block layout: the record header, n_items pairs and then the string arena.
+ * String values refer to the arena by offset so the block can grow with
+ * g_realloc, other values are stored in the pair. Names are interned
+ * strings and only referenced.
  */
 
 /******************** MACRO DEFINITION SECTION ********************************/
 
+/**
+ * Max number of free records kept in the pool.
+ */
+#define POOL_SIZE (64)
+
+/**
+ * Initial size of the string arena of a new block.
+ */
+#define ARENA_SIZE (256)
+
 /******************** LOCAL VARIABLE DECLARATION SECTION **********************/
 
+/**
+ * Position of a string in the record arena.
+ */
+typedef struct mdp_span
+{
+    guint offset;
+    guint length;
+} mdp_span;
+
+/**
+ * Key-value pair of metadata items. Used for the different reporting methods.
+ */
+typedef struct mdp_item_pair
+{
+    const gchar    *name;
+    mdp_value_type type;
+    union {
+        mdp_span string;
+        gboolean boolean;
+        gint64   integer;
+        gdouble  number;
+    } value;
+} mdp_item_pair;
+
+struct mdp_record
+{
+    mdp_record    *next;
+    gint          ref_count;
+    gsize         block_size;
+    gsize         arena_used;
+    guint         n_items;
+    mdp_item_pair items[];
+};
+
+/**
+ * Pool of free records, shared by the event callback and the pipeline.
+ */
+static GMutex pool_mutex;
+static mdp_record *pool      = NULL;
+static guint      pool_count = 0;
+
 /******************** LOCAL FUNCTION DECLARATION SECTION **********************/
 
 /**
- * Helper function to use for freeing and mdp item pair.
+ * Get the start of the string arena of a record.
  *
- * @param data Pointer to the data pair.
+ * @param record The record.
+ *
+ * @return Pointer to the first arena byte.
+ */
+static gchar *arena(const mdp_record *record);
+
+/**
+ * Copy a string into the arena, growing the block if needed.
+ *
+ * @param record_p Pointer to the record, updated if the block moved.
+ * @param string   The string to copy.
+ * @param span     Return location for the position of the copy.
  *
  * @return No return value.
  */
-static void mdp_free_item_pair(gpointer data);
+static void arena_append(mdp_record **record_p,
+                         const char *string,
+                         mdp_span *span);
+
+/**
+ * Format an integer in decimal without going through printf.
+ *
+ * @param value  The value.
+ * @param buffer Buffer of at least MDP_FORMAT_SIZE bytes.
+ *
+ * @return The buffer.
+ */
+static gchar *format_integer(gint64 value, gchar *buffer);
 
 /******************** LOCAL FUNCTION DEFINTION SECTION ************************/
 
-static void mdp_free_item_pair(gpointer data)
+/**
+ * Get the start of the string arena of a record.
+ */
+static gchar *arena(const mdp_record *record)
 {
-    if (data == NULL) {
-        return;
+    return (gchar *) &record->items[record->n_items];
+}
+
+/**
+ * Copy a string into the arena, growing the block if needed.
+ */
+static void arena_append(mdp_record **record_p,
+                         const char *string,
+                         mdp_span *span)
+{
+    mdp_record *record = *record_p;
+    gsize length       = strlen(string);
+    gsize header       = (gsize) (arena(record) - (gchar *) record);
+    gsize needed       = header + record->arena_used + length + 1;
+
+    if (needed > record->block_size) {
+        gsize block_size = record->block_size * 2;
+
+        while (block_size < needed) {
+            block_size *= 2;
+        }
+
+        record             = g_realloc(record, block_size);
+        record->block_size = block_size;
+        *record_p          = record;
+    }
+
+    span->offset = record->arena_used;
+    span->length = length;
+
+    memcpy(arena(record) + record->arena_used, string, length + 1);
+    record->arena_used += length + 1;
+}
+
+/**
+ * Format an integer in decimal, digits are generated backwards.
+ */
+static gchar *format_integer(gint64 value, gchar *buffer)
+{
+    gchar   digits[MDP_FORMAT_SIZE];
+    guint64 magnitude = value < 0 ? -(guint64) value : (guint64) value;
+    guint   n_digits  = 0;
+    guint   length    = 0;
+
+    do {
+        digits[n_digits++] = '0' + (magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) {
+        buffer[length++] = '-';
+    }
+
+    while (n_digits > 0) {
+        buffer[length++] = digits[--n_digits];
     }
 
-    mdp_item_pair * item_pair = data;
+    buffer[length] = '\0';
 
-    g_free(item_pair->name);
-    g_free(item_pair->value);
-    g_free(item_pair);
+    return buffer;
 }
 
 /******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
 
 /**
- * Free tuple of metadata items, used in g_list_free_full
+ * Format a double, 15 digits is enough for most values and gives the
+ * expected text for e.g. 0.1, 17 digits always round trips.
  */
-void mdp_destroy_list(GList **list)
+gchar *mdp_format_double(gdouble value, gchar *buffer)
 {
-    if (list == NULL) {
+    g_ascii_formatd(buffer, MDP_FORMAT_SIZE, "%.15g", value);
+
+    if (isfinite(value) && g_ascii_strtod(buffer, NULL) != value) {
+        g_ascii_formatd(buffer, MDP_FORMAT_SIZE, "%.17g", value);
+    }
+
+    return buffer;
+}
+
+/**
+ * Take a record from the pool or allocate a new one.
+ */
+mdp_record *mdp_record_new(guint n_items)
+{
+    mdp_record *record = NULL;
+    gsize header       = sizeof(mdp_record) + n_items * sizeof(mdp_item_pair);
+
+    g_mutex_lock(&pool_mutex);
+
+    if (pool != NULL) {
+        record = pool;
+        pool   = record->next;
+        pool_count--;
+    }
+
+    g_mutex_unlock(&pool_mutex);
+
+    if (record == NULL) {
+        record             = g_malloc(header + ARENA_SIZE);
+        record->block_size = header + ARENA_SIZE;
+    } else if (record->block_size < header + ARENA_SIZE) {
+        record             = g_realloc(record, header + ARENA_SIZE);
+        record->block_size = header + ARENA_SIZE;
+    }
+
+    record->next       = NULL;
+    record->ref_count  = 1;
+    record->arena_used = 1;
+    record->n_items    = n_items;
+
+    /* Offset 0 is an empty string, unset values point there */
+    guint i = 0;
+    for (; i < n_items; i++) {
+        record->items[i].name                = "";
+        record->items[i].type                = MDP_TYPE_STRING;
+        record->items[i].value.string.offset = 0;
+        record->items[i].value.string.length = 0;
+    }
+
+    arena(record)[0] = '\0';
+
+    return record;
+}
+
+/**
+ * Reference name and copy string value of an item into the record.
+ */
+void mdp_record_set_string(mdp_record **record_p,
+                           guint index,
+                           const char *name,
+                           const char *value)
+{
+    g_assert(record_p && *record_p);
+    g_assert(index < (*record_p)->n_items);
+
+    mdp_span value_span;
+
+    arena_append(record_p, value, &value_span);
+
+    (*record_p)->items[index].name         = name;
+    (*record_p)->items[index].type         = MDP_TYPE_STRING;
+    (*record_p)->items[index].value.string = value_span;
+}
+
+/**
+ * Set name and boolean value of an item.
+ */
+void mdp_record_set_boolean(mdp_record *record,
+                            guint index,
+                            const char *name,
+                            gboolean value)
+{
+    g_assert(record && index < record->n_items);
+
+    record->items[index].name          = name;
+    record->items[index].type          = MDP_TYPE_BOOLEAN;
+    record->items[index].value.boolean = value;
+}
+
+/**
+ * Set name and integer value of an item.
+ */
+void mdp_record_set_integer(mdp_record *record,
+                            guint index,
+                            const char *name,
+                            gint64 value)
+{
+    g_assert(record && index < record->n_items);
+
+    record->items[index].name          = name;
+    record->items[index].type          = MDP_TYPE_INTEGER;
+    record->items[index].value.integer = value;
+}
+
+/**
+ * Set name and floating point value of an item.
+ */
+void mdp_record_set_double(mdp_record *record,
+                           guint index,
+                           const char *name,
+                           gdouble value)
+{
+    g_assert(record && index < record->n_items);
+
+    record->items[index].name         = name;
+    record->items[index].type         = MDP_TYPE_DOUBLE;
+    record->items[index].value.number = value;
+}
+
+/**
+ * Get number of items in a record.
+ */
+guint mdp_record_size(const mdp_record *record)
+{
+    return record == NULL ? 0 : record->n_items;
+}
+
+/**
+ * Get the name of an item.
+ */
+const gchar *mdp_record_name(const mdp_record *record, guint index)
+{
+    return record->items[index].name;
+}
+
+/**
+ * Get the native type of an item value.
+ */
+mdp_value_type mdp_record_type(const mdp_record *record, guint index)
+{
+    return record->items[index].type;
+}
+
+/**
+ * Check if an item value can be written as a plain number.
+ */
+gboolean mdp_record_is_number(const mdp_record *record, guint index)
+{
+    const mdp_item_pair *item = &record->items[index];
+
+    return item->type == MDP_TYPE_INTEGER ||
+        (item->type == MDP_TYPE_DOUBLE && isfinite(item->value.number));
+}
+
+/**
+ * Get the value of an item as text, formatted on demand.
+ */
+const gchar *mdp_record_format(const mdp_record *record,
+                               guint index,
+                               gchar *buffer)
+{
+    const mdp_item_pair *item = &record->items[index];
+
+    switch (item->type) {
+    case MDP_TYPE_BOOLEAN:
+        return item->value.boolean ? "yes" : "no";
+    case MDP_TYPE_INTEGER:
+        return format_integer(item->value.integer, buffer);
+    case MDP_TYPE_DOUBLE:
+        return mdp_format_double(item->value.number, buffer);
+    case MDP_TYPE_STRING:
+    default:
+        return arena(record) + item->value.string.offset;
+    }
+}
+
+/**
+ * Take a reference to a record.
+ */
+mdp_record *mdp_record_ref(mdp_record *record)
+{
+    if (record != NULL) {
+        g_atomic_int_inc(&record->ref_count);
+    }
+
+    return record;
+}
+
+/**
+ * Drop a reference, return the record to the pool or free it if the pool
+ * is full when it was the last one.
+ */
+void mdp_record_unref(mdp_record **record_p)
+{
+    if (record_p == NULL) {
         return;
     }
 
-    if (*list == NULL) {
+    if (*record_p == NULL) {
+        return;
+    }
+
+    mdp_record *record = *record_p;
+
+    *record_p = NULL;
+
+    if (g_atomic_int_dec_and_test(&record->ref_count) == FALSE) {
         return;
     }
 
-    g_list_free_full(*list, mdp_free_item_pair);
+    g_mutex_lock(&pool_mutex);
+
+    if (pool_count < POOL_SIZE) {
+        record->next = pool;
+        pool         = record;
+        pool_count++;
+        record       = NULL;
+    }
 
-    *list = NULL;
-}
\ No newline at end of file
+    g_mutex_unlock(&pool_mutex);
+
+    g_free(record);
+}
+
+/**
+ * Free all records kept in the pool.
+ */
+void mdp_pool_cleanup(void)
+{
+    g_mutex_lock(&pool_mutex);
+
+    while (pool != NULL) {
+        mdp_record *record = pool;
+        pool = record->next;
+        g_free(record);
+    }
+
+    pool_count = 0;
+
+    g_mutex_unlock(&pool_mutex);
+}
@@ -1,23 +1,208 @@
 #ifndef INCLUSION_GUARD_METADATA_PAIR_H
 #define INCLUSION_GUARD_METADATA_PAIR_H
 
+#include <glib.h>
+
 /** @file metadata_pair.h
- * @Brief Header file abstracting metadata pair object and lists.
+ * @Brief Header file abstracting metadata records.
+ *
+ * A record holds the name/value pairs of the metadata items of one event.
+ * The pairs and all their strings live in a single arena block, and freed
+ * blocks are kept in a pool for the next event so that a record costs one
+ * allocation at most and none once the pool is warm.
+ *
+ * Once filled in a record is immutable and reference counted, so the same
+ * record can be handed to ACS, the overlay and other sinks without copying.
+ * It goes back to the pool when the last reference is dropped.
  *
+ * Values keep their native type and are only turned into text by the sinks
+ * that need it, using mdp_record_format().
+ */
+
+/**
+ * Size of a buffer large enough for any value formatted by
+ * mdp_record_format() that is not a string.
  */
+#define MDP_FORMAT_SIZE (G_ASCII_DTOSTR_BUF_SIZE)
 
 /**
- * Key-value pair of metadata items. Used for the different reporting methods.
+ * Native type of a metadata value.
  */
-typedef struct mdp_item_pair
+typedef enum mdp_value_type
 {
-    gchar *name;
-    gchar *value;
-} mdp_item_pair;
+    MDP_TYPE_STRING = 0,
+    MDP_TYPE_BOOLEAN,
+    MDP_TYPE_INTEGER,
+    MDP_TYPE_DOUBLE
+} mdp_value_type;
+
+/**
+ * Forward-declared metadata record.
+ */
+typedef struct mdp_record mdp_record;
+
+/**
+ * Take a record for n_items pairs from the pool, all names and values empty.
+ * The caller holds the only reference.
+ *
+ * @param n_items Number of items in the record.
+ *
+ * @return The new record.
+ */
+mdp_record *mdp_record_new(guint n_items);
+
+/**
+ * Set the name and string value of an item. The name is stored by pointer
+ * and the value is copied into the record. The record may move in memory.
+ * Setters are only allowed before the record is shared.
+ *
+ * @param record_p Pointer to the record, updated if the record moved.
+ * @param index    Index of the item.
+ * @param name     Name of the item, an interned string (g_intern_string).
+ * @param value    Value of the item.
+ *
+ * @return No return value.
+ */
+void mdp_record_set_string(mdp_record **record_p,
+                           guint index,
+                           const char *name,
+                           const char *value);
 
 /**
- * Destroy a GList of mdp_item_pair objects.
+ * Set the name and boolean value of an item.
+ *
+ * @param record The record.
+ * @param index  Index of the item.
+ * @param name   Name of the item, an interned string (g_intern_string).
+ * @param value  Value of the item.
+ *
+ * @return No return value.
+ */
+void mdp_record_set_boolean(mdp_record *record,
+                            guint index,
+                            const char *name,
+                            gboolean value);
+
+/**
+ * Set the name and integer value of an item.
+ *
+ * @param record The record.
+ * @param index  Index of the item.
+ * @param name   Name of the item, an interned string (g_intern_string).
+ * @param value  Value of the item.
+ *
+ * @return No return value.
+ */
+void mdp_record_set_integer(mdp_record *record,
+                            guint index,
+                            const char *name,
+                            gint64 value);
+
+/**
+ * Set the name and floating point value of an item.
+ *
+ * @param record The record.
+ * @param index  Index of the item.
+ * @param name   Name of the item, an interned string (g_intern_string).
+ * @param value  Value of the item.
+ *
+ * @return No return value.
+ */
+void mdp_record_set_double(mdp_record *record,
+                           guint index,
+                           const char *name,
+                           gdouble value);
+
+/**
+ * Get number of items in a record.
+ *
+ * @param record The record, NULL has no items.
+ *
+ * @return Number of items.
+ */
+guint mdp_record_size(const mdp_record *record);
+
+/**
+ * Get the name of an item.
+ *
+ * @param record The record.
+ * @param index  Index of the item.
+ *
+ * @return The interned name, can be compared by pointer.
+ */
+const gchar *mdp_record_name(const mdp_record *record, guint index);
+
+/**
+ * Get the native type of an item value.
+ *
+ * @param record The record.
+ * @param index  Index of the item.
+ *
+ * @return The value type.
+ */
+mdp_value_type mdp_record_type(const mdp_record *record, guint index);
+
+/**
+ * Check if an item value can be written as a plain number, i.e. it is an
+ * integer or a finite floating point value.
+ *
+ * @param record The record.
+ * @param index  Index of the item.
+ *
+ * @return TRUE for numbers, FALSE otherwise.
+ */
+gboolean mdp_record_is_number(const mdp_record *record, guint index);
+
+/**
+ * Get the value of an item as text. Strings are returned as stored, other
+ * values are formatted into the buffer: booleans as yes/no, integers in
+ * decimal and doubles with the shortest precision that reads back exactly.
+ *
+ * @param record The record.
+ * @param index  Index of the item.
+ * @param buffer Buffer of at least MDP_FORMAT_SIZE bytes.
+ *
+ * @return The text, valid as long as both the record and buffer are.
+ */
+const gchar *mdp_record_format(const mdp_record *record,
+                               guint index,
+                               gchar *buffer);
+
+/**
+ * Format a double the way mdp_record_format() does, with the shortest of 15
+ * or 17 significant digits that reads back as the same value.
+ *
+ * @param value  The value.
+ * @param buffer Buffer of at least MDP_FORMAT_SIZE bytes.
+ *
+ * @return The buffer.
+ */
+gchar *mdp_format_double(gdouble value, gchar *buffer);
+
+/**
+ * Take a reference to a record. Safe to call from any thread.
+ *
+ * @param record The record, may be NULL.
+ *
+ * @return The record.
+ */
+mdp_record *mdp_record_ref(mdp_record *record);
+
+/**
+ * Drop a reference to a record, the last one returns the record to the
+ * pool. Safe to call from any thread.
+ *
+ * @param record_p Pointer to the record, set to NULL on return.
+ *
+ * @return No return value.
+ */
+void mdp_record_unref(mdp_record **record_p);
+
+/**
+ * Free all records kept in the pool.
+ *
+ * @return No return value.
  */
-void mdp_destroy_list(GList **list);
+void mdp_pool_cleanup(void);
 
-#endif // INCLUSION_GUARD_METADATA_PAIR_H
\ No newline at end of file
+#endif // INCLUSION_GUARD_METADATA_PAIR_H
@@ -1,7 +1,6 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <time.h>
 
 #include <glib.h>
 #include <glib-object.h>
@@ -9,72 +8,277 @@
 #include <cairo/cairo.h>
 #include <axoverlay.h>
 
+#include "metadata_pair.h"
 #include "overlay.h"
 #include "debug.h"
-#include "metadata_pair.h"
 
 /** @file overlay.c
  * @Brief Overlay implementation
  *
+ * All axoverlay work runs on a dedicated thread with its own GMainContext,
+ * so neither a busy GMainLoop nor a slow overlayd can stall the other side.
+ * The pipeline thread hands over content as immutable snapshots through a
+ * single pending slot swapped atomically. A snapshot replaced before the
+ * overlay thread took it is dropped, it would never have been shown.
+ *
+ * Nothing is redrawn periodically. A new update schedules one redraw on
+ * the overlay thread, which also arms a one-shot timer removing the items again
+ * when they expire. An idle overlay costs no CPU at all. Redraws are rate
+ * limited, under bursts only the latest update of each interval is shown.
+ *
+ * Every channel has an overlay of its own, created on its camera so
+ * axoverlay only shows it on the streams of that camera. axoverlay can only
+ * be initialized once per process, so all the overlays share the one overlay
+ * thread. It is started with the first overlay and stopped with the last
+ * one.
+ *
+ * The overlay is resized to the measured text on every content change so
+ * buffer memory and compositing scale with what is shown. The text is then
+ * rasterized into an A8 mask once per stream resolution, at the scale of
+ * that stream, and the render callback only composites the mask in the
+ * text color.
  */
 
 /******************** MACRO DEFINITION SECTION ********************************/
 
-#define OVERLAY_WIDTH 600
-#define OVERLAY_HEIGHT 400
+/**
+ * Largest overlay, in source coordinates.
+ */
+#define MAX_OVERLAY_WIDTH 1920
+#define MAX_OVERLAY_HEIGHT 1080
+
+/**
+ * Overlay sizes are rounded up to a multiple of this.
+ */
+#define SIZE_ALIGN 16
+#define ALIGN_SIZE(size) (((size) + SIZE_ALIGN - 1) / SIZE_ALIGN * SIZE_ALIGN)
+
+/**
+ * Text layout, font size, baseline of the header and line spacing.
+ */
+#define FONT_SIZE 40
+#define FIRST_BASELINE 40
+#define LINE_HEIGHT 50
+
+/**
+ * Text color.
+ */
+#define TEXT_RED 51
+#define TEXT_GREEN 204
+#define TEXT_BLUE 255
+
+/**
+ * Number of colors in the 4-bit palette. Index 0 is transparent, the others
+ * are the text color at increasing opacity to keep the anti-aliasing.
+ */
+#define PALETTE_SIZE 16
+
+/**
+ * Overlay id while there is no axoverlay overlay.
+ */
+#define NO_OVERLAY (-1)
+
+/**
+ * Number of stream resolutions with a cached layout.
+ */
+#define MAX_LAYOUTS 8
+
+/**
+ * Shortest time in ms between two overlay updates. Updates arriving faster
+ * are coalesced and only the latest one is shown.
+ */
+#define MIN_UPDATE_INTERVAL 200
 
-#define ANIMATION_FPS 10
+/**
+ * Max length of one rendered item line, longer lines are cut off anyway.
+ */
+#define TEXT_SIZE 256
 
 /******************** LOCAL VARIABLE DECLARATION SECTION **********************/
 
+/**
+ * Function run on the overlay thread with call_overlay_thread().
+ */
+typedef gboolean (*overlay_func)(gpointer data);
+
+/**
+ * A call to the overlay thread, completed when done is set.
+ */
+typedef struct overlay_call
+{
+    overlay_func func;
+    gpointer data;
+    gboolean result;
+    gboolean done;
+} overlay_call;
+
+/**
+ * Text rendered for one stream resolution, current while generation
+ * matches the overlay content generation.
+ */
+typedef struct stream_layout
+{
+    gint stream_width;
+    gint stream_height;
+    gint width;
+    gint height;
+    guint generation;
+    guint last_used;
+    cairo_surface_t *mask;
+} stream_layout;
+
+/**
+ * Content of one update, immutable once handed to the overlay thread.
+ */
+typedef struct overlay_snapshot
+{
+    mdp_record *items;
+    const gchar *analytic_text;
+    guint time;
+    struct overlay_snapshot *next;
+} overlay_snapshot;
+
 typedef struct overlay
 {
-    gint animation_timer;
+    /* Shared between the threads */
+    gpointer pending;
+    volatile gint palette_request;
+    GSource *wake_source;
+    GMutex mutex;
+
+    /* Free snapshots, under the mutex */
+    overlay_snapshot *free_snapshots;
+
+    /* Camera the overlay is drawn on, 0 for all */
+    guint camera;
+
+    /* Producer side, only used by overlay_set_data() under the mutex */
+    const gchar *analytic;
+    const gchar *category;
+    const gchar *analytic_text;
+
+    /* Overlay thread only */
+    overlay_snapshot *shown;
+    GSource *update_source;
+    gint64 last_update;
+    GSource *expiry_timer;
     gint overlay_id;
-    GList *cur_list;
-    gchar *analytic_text;
-    struct timespec start;
-    struct timespec stop;
-    gint timeout_us;
     gboolean timer_elapsed;
+    stream_layout layouts[MAX_LAYOUTS];
+    guint generation;
+    guint frame;
+    gint width;
+    gint height;
+    gboolean palette;
 } overlay;
 
+/**
+ * Overlay thread and its GMainContext, running while there are overlays.
+ * Only started and stopped from the GMainLoop.
+ */
+static GMainContext *context = NULL;
+static GMainLoop *loop = NULL;
+static GThread *thread = NULL;
+static guint n_overlays = 0;
+
+/**
+ * Completion of calls made with call_overlay_thread().
+ */
+static GMutex call_mutex;
+static GCond call_cond;
+
 /******************** LOCAL FUNCTION DECLARATION SECTION **********************/
 
-static void reset_clock(const overlay_handle handle)
+/**
+ * Create the axoverlay overlay at the current size, in ARGB32 or in the
+ * 4-bit palette colorspace.
+ */
+static gboolean create_overlay(const overlay_handle handle, gboolean palette)
 {
-    g_assert(handle);
+    GError *error = NULL;
 
-    clock_gettime(CLOCK_MONOTONIC, &handle->start);
-    handle->timer_elapsed = FALSE;
-}
+    struct axoverlay_overlay_data data;
+    axoverlay_init_overlay_data(&data);
+    data.postype = AXOVERLAY_CUSTOM_SOURCE;
+    data.anchor_point = AXOVERLAY_ANCHOR_TOP_LEFT;
+    data.x = 0.0;
+    data.y = 0.0;
+    data.width = handle->width;
+    data.height = handle->height;
+    data.colorspace = palette ? AXOVERLAY_COLORSPACE_4BIT_PALETTE :
+        AXOVERLAY_COLORSPACE_ARGB32;
+    data.scale_to_stream = TRUE;
 
-static void check_elapsed_time(const overlay_handle handle)
-{
-    struct timespec *stop  = &handle->stop;
-    struct timespec *start = &handle->start; 
+    /* The overlay of a channel is only shown on the streams of its camera */
+    if (handle->camera != 0) {
+        data.camera = handle->camera;
+    }
+
+    handle->overlay_id = axoverlay_create_overlay(&data, handle, &error);
+    if (error != NULL) {
+        ERR("Failed to create %s overlay: %s", palette ? "palette" : "ARGB",
+            error->message);
+        g_error_free(error);
+        handle->overlay_id = NO_OVERLAY;
+        return FALSE;
+    }
 
-    clock_gettime(CLOCK_MONOTONIC, stop);
+    handle->palette = palette;
 
-    double result = (stop->tv_sec - start->tv_sec) * 1e6 + 
-        (stop->tv_nsec - start->tv_nsec) / 1e3;
+    gint i = 0;
+    for (; palette && i < PALETTE_SIZE; i++) {
+        struct axoverlay_palette_color color = {
+            .red      = TEXT_RED,
+            .green    = TEXT_GREEN,
+            .blue     = TEXT_BLUE,
+            .alpha    = i * 255 / (PALETTE_SIZE - 1),
+            .pixelate = FALSE,
+        };
 
-    if ((int) result >= handle->timeout_us) {
-        handle->timer_elapsed = TRUE;
+        axoverlay_set_palette_color(i, &color, &error);
+        if (error != NULL) {
+            ERR("Failed to set palette color %d: %s", i, error->message);
+            g_error_free(error);
+            error = NULL;
+        }
     }
+
+    return TRUE;
 }
 
-static gboolean update_overlay_cb(gpointer data)
+/**
+ * Quantize the text mask to palette indexes. A palette index is drawn as
+ * the index times 17 in every channel, so each alpha value is rounded to
+ * the nearest such step.
+ */
+static void quantize_text(cairo_surface_t *mask)
 {
-    g_assert(data);
+    guchar *pixels = cairo_image_surface_get_data(mask);
+    gint stride    = cairo_image_surface_get_stride(mask);
+    gint width     = cairo_image_surface_get_width(mask);
+    gint height    = cairo_image_surface_get_height(mask);
+    gint step      = 255 / (PALETTE_SIZE - 1);
 
-    GError *error = NULL;
+    gint y = 0;
+    for (; y < height; y++) {
+        guchar *row = pixels + y * stride;
 
-    overlay_handle handle = data;
+        gint x = 0;
+        for (; x < width; x++) {
+            row[x] = (row[x] + step / 2) / step * step;
+        }
+    }
 
-    check_elapsed_time(handle);
+    cairo_surface_mark_dirty(mask);
+}
+
+/**
+ * Request a redraw of the overlay, only call from the overlay thread.
+ */
+static void request_redraw(void)
+{
+    GError *error = NULL;
 
-    /* Request a redraw of the overlay */
     axoverlay_redraw(&error);
     if (error != NULL) {
     /*
@@ -85,10 +289,449 @@ static gboolean update_overlay_cb(gpointer data)
     ERR("Failed to redraw overlay (%d): %s\n", error->code, error->message);
     g_error_free(error);
     }
+}
+
+/**
+ * Show or measure the header and the item lines.
+ */
+static void draw_lines(const overlay_handle handle, cairo_t *cr,
+                       gboolean measure, gint *width, gint *height)
+{
+    cairo_text_extents_t extents;
+    cairo_font_extents_t font;
+    int offset = FIRST_BASELINE;
+
+    cairo_select_font_face(cr, "sans-serif",
+      CAIRO_FONT_SLANT_NORMAL,
+      CAIRO_FONT_WEIGHT_BOLD);
+    cairo_set_font_size(cr, FONT_SIZE);
+
+    if (measure) {
+        cairo_font_extents(cr, &font);
+        *width  = 0;
+        *height = 0;
+    }
+
+    if (handle->shown == NULL) {
+        return;
+    }
+
+    guint n_items = handle->timer_elapsed ? 0 :
+        mdp_record_size(handle->shown->items);
+
+    /* Line 0 is the header, don't add metadata in case the timer elapsed */
+    guint i = 0;
+    for (; i <= n_items; i++) {
+        gchar buffer[MDP_FORMAT_SIZE];
+        gchar text[TEXT_SIZE];
+        const gchar *line = text;
+
+        if (i == 0) {
+            line = handle->shown->analytic_text;
+        } else {
+            const mdp_record *items = handle->shown->items;
+
+            g_snprintf(text, sizeof(text), "%s : %s",
+                mdp_record_name(items, i - 1),
+                mdp_record_format(items, i - 1, buffer));
+        }
+
+        if (measure) {
+            cairo_text_extents(cr, line, &extents);
+            *width  = MAX(*width, (gint) (MAX(extents.x_advance,
+                extents.x_bearing + extents.width) + 1));
+            *height = offset + (gint) (font.descent + 1);
+        } else {
+            cairo_move_to(cr, 0, offset);
+            cairo_show_text(cr, line);
+        }
+
+        offset += LINE_HEIGHT;
+    }
+}
+
+/**
+ * Measure the text, resize the overlay to fit and invalidate the stream
+ * layouts. Not done in the render callback since the overlay size can't
+ * change while it is drawn.
+ */
+static void layout_text(const overlay_handle handle)
+{
+    gint width  = 0;
+    gint height = 0;
+
+    /* Any surface will do for measuring */
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_A8,
+        1, 1);
+    cairo_t *cr = cairo_create(surface);
+
+    draw_lines(handle, cr, TRUE, &width, &height);
+
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
+
+    width  = CLAMP(ALIGN_SIZE(width), SIZE_ALIGN, MAX_OVERLAY_WIDTH);
+    height = CLAMP(ALIGN_SIZE(height), SIZE_ALIGN,
+        MAX_OVERLAY_HEIGHT);
+
+    /* Nothing to resize while the overlay is missing */
+    if (handle->overlay_id == NO_OVERLAY) {
+        return;
+    }
+
+    if (width != handle->width || height != handle->height) {
+        GError *error = NULL;
+        struct axoverlay_overlay_data data;
+
+        axoverlay_get_overlay_data(handle->overlay_id, &data, &error);
+
+        if (error == NULL) {
+            data.width  = width;
+            data.height = height;
+            axoverlay_update_overlay_data(handle->overlay_id, &data, &error);
+        }
+
+        if (error != NULL) {
+            ERR("Failed to resize overlay to %dx%d: %s", width, height,
+                error->message);
+            g_error_free(error);
+        } else {
+            DBG_LOG("Resized overlay to %dx%d", width, height);
+            handle->width  = width;
+            handle->height = height;
+        }
+    }
+
+    handle->generation++;
+}
+
+/**
+ * Get the layout of a stream, rasterizing the text at the scale of the
+ * stream if the content changed since it was last drawn. Layouts are
+ * keyed by stream resolution, the least recently used one is replaced
+ * when a new resolution shows up.
+ */
+static stream_layout *get_layout(const overlay_handle handle,
+                                 const struct axoverlay_stream_data *stream,
+                                 gint width, gint height)
+{
+    stream_layout *layout = &handle->layouts[0];
+
+    guint i = 0;
+    for (; i < MAX_LAYOUTS; i++) {
+        stream_layout *candidate = &handle->layouts[i];
+
+        if (candidate->stream_width == stream->width &&
+            candidate->stream_height == stream->height) {
+            layout = candidate;
+            break;
+        }
+
+        if (candidate->last_used < layout->last_used) {
+            layout = candidate;
+        }
+    }
+
+    layout->last_used = ++handle->frame;
+
+    if (layout->mask != NULL && layout->generation == handle->generation &&
+        layout->width == width && layout->height == height) {
+        return layout;
+    }
+
+    if (layout->mask != NULL &&
+        (layout->width != width || layout->height != height)) {
+        cairo_surface_destroy(layout->mask);
+        layout->mask = NULL;
+    }
+
+    if (layout->mask == NULL) {
+        layout->mask = cairo_image_surface_create(CAIRO_FORMAT_A8,
+            MAX(width, 1), MAX(height, 1));
+    }
+
+    layout->stream_width  = stream->width;
+    layout->stream_height = stream->height;
+    layout->width         = width;
+    layout->height        = height;
+    layout->generation    = handle->generation;
+
+    cairo_t *cr = cairo_create(layout->mask);
+
+    /* Clear background */
+    cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(cr);
+
+    /* Draw the text, the color is applied when the mask is composited */
+    cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 1.0);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+
+    /* Lay out in source coordinates, scaled to the stream */
+    cairo_scale(cr, (double) width / handle->width,
+        (double) height / handle->height);
+
+    draw_lines(handle, cr, FALSE, NULL, NULL);
+
+    cairo_destroy(cr);
+    cairo_surface_flush(layout->mask);
+
+    if (handle->palette) {
+        quantize_text(layout->mask);
+    }
+
+    return layout;
+}
+
+/**
+ * Attach an idle source, or a timeout source if a time is given, to the
+ * overlay context.
+ */
+static GSource *attach_source(const overlay_handle handle, guint time,
+                              GSourceFunc func)
+{
+    GSource *source = time == 0 ? g_idle_source_new() :
+        g_timeout_source_new(time);
+
+    g_source_set_callback(source, func, handle, NULL);
+    g_source_attach(source, context);
+
+    return source;
+}
+
+/**
+ * Remove a source attached with attach_source().
+ */
+static void remove_source(GSource **source_p)
+{
+    if (*source_p != NULL) {
+        g_source_destroy(*source_p);
+        g_source_unref(*source_p);
+        *source_p = NULL;
+    }
+}
+
+/**
+ * Take a snapshot from the free snapshots or allocate a new one.
+ */
+static overlay_snapshot *new_snapshot(const overlay_handle handle)
+{
+    g_mutex_lock(&handle->mutex);
+
+    overlay_snapshot *snapshot = handle->free_snapshots;
+
+    if (snapshot != NULL) {
+        handle->free_snapshots = snapshot->next;
+    }
+
+    g_mutex_unlock(&handle->mutex);
+
+    if (snapshot == NULL) {
+        snapshot = g_new0(overlay_snapshot, 1);
+    }
+
+    snapshot->next = NULL;
+
+    return snapshot;
+}
+
+/**
+ * Release the record of a snapshot and return it to the free snapshots.
+ * At most one snapshot is pending, one shown and one being published by
+ * each producer, so the free snapshots are not capped.
+ */
+static void free_snapshot(const overlay_handle handle,
+                          overlay_snapshot *snapshot)
+{
+    if (snapshot != NULL) {
+        mdp_record_unref(&snapshot->items);
+
+        g_mutex_lock(&handle->mutex);
+        snapshot->next         = handle->free_snapshots;
+        handle->free_snapshots = snapshot;
+        g_mutex_unlock(&handle->mutex);
+    }
+}
+
+/**
+ * Atomically replace the pending snapshot.
+ */
+static overlay_snapshot *swap_pending(const overlay_handle handle,
+                                      overlay_snapshot *snapshot)
+{
+    gpointer old;
+
+    do {
+        old = g_atomic_pointer_get(&handle->pending);
+    } while (!g_atomic_pointer_compare_and_exchange(&handle->pending, old,
+        snapshot));
+
+    return old;
+}
+
+/**
+ * One-shot timer removing the items once they have been shown long enough.
+ */
+static gboolean expire_overlay_cb(gpointer data)
+{
+    g_assert(data);
+
+    overlay_handle handle = data;
+
+    g_source_unref(handle->expiry_timer);
+    handle->expiry_timer = NULL;
+
+    handle->timer_elapsed = TRUE;
+    layout_text(handle);
+
+    request_redraw();
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Take the latest snapshot, lay out the new text, redraw and restart the
+ * expiry timer for the new items.
+ */
+static gboolean update_overlay_cb(gpointer data)
+{
+    g_assert(data);
+
+    overlay_handle handle = data;
+
+    g_source_unref(handle->update_source);
+    handle->update_source = NULL;
+
+    overlay_snapshot *snapshot = swap_pending(handle, NULL);
+
+    if (snapshot == NULL) {
+        return G_SOURCE_REMOVE;
+    }
+
+    free_snapshot(handle, handle->shown);
+    handle->shown         = snapshot;
+    handle->last_update   = g_get_monotonic_time();
+    handle->timer_elapsed = FALSE;
+
+    layout_text(handle);
+
+    remove_source(&handle->expiry_timer);
+
+    /* A time of 0 keeps the items until the next update */
+    if (snapshot->time != 0) {
+        handle->expiry_timer = attach_source(handle, snapshot->time,
+            expire_overlay_cb);
+    }
+
+    request_redraw();
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Invoked on the overlay thread when a snapshot is pending. Takes it right
+ * away, or at the end of the update interval. Snapshots published until
+ * then replace the pending one and share the update.
+ */
+static gboolean wake_overlay_cb(gpointer data)
+{
+    overlay_handle handle = data;
+
+    if (handle->update_source != NULL) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    gint64 wait = handle->last_update + MIN_UPDATE_INTERVAL * 1000 -
+        g_get_monotonic_time();
+
+    handle->update_source = attach_source(handle,
+        wait > 0 ? (guint) (wait / 1000) + 1 : 0, update_overlay_cb);
 
     return G_SOURCE_CONTINUE;
 }
 
+/**
+ * Dispatch the wake source of an overlay. It stays attached and is
+ * disarmed until the next snapshot is published.
+ */
+static gboolean dispatch_wake(GSource *source, GSourceFunc callback,
+                              gpointer user_data)
+{
+    g_source_set_ready_time(source, -1);
+
+    return callback(user_data);
+}
+
+static GSourceFuncs wake_source_funcs = {
+    .dispatch = dispatch_wake,
+};
+
+/**
+ * Invoked on the overlay thread to switch colorspace by recreating the
+ * overlay.
+ */
+static gboolean palette_overlay_cb(gpointer data)
+{
+    overlay_handle handle = data;
+    gboolean palette      = g_atomic_int_get(&handle->palette_request);
+
+    /* A missing overlay is created again on any request */
+    if (palette == handle->palette && handle->overlay_id != NO_OVERLAY) {
+        return G_SOURCE_REMOVE;
+    }
+
+    if (handle->overlay_id != NO_OVERLAY) {
+        axoverlay_destroy_overlay(handle->overlay_id, NULL);
+        handle->overlay_id = NO_OVERLAY;
+    }
+
+    /* Palette not supported by the backend, keep drawing in ARGB32 */
+    if (!create_overlay(handle, palette) &&
+        (palette == FALSE || !create_overlay(handle, FALSE))) {
+        ERR("No overlay, failed to recreate it");
+        return G_SOURCE_REMOVE;
+    }
+
+    if (palette != handle->palette) {
+        LOG("Palette overlay not supported, using ARGB32");
+    }
+
+    /* Layouts are quantized for the palette, draw them again */
+    handle->generation++;
+
+    request_redraw();
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Invoked on the overlay thread to stop it.
+ */
+static gboolean quit_overlay_cb(gpointer data)
+{
+    (void) data;
+
+    g_main_loop_quit(loop);
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Run a call on the overlay thread and wake up the caller.
+ */
+static gboolean run_call_cb(gpointer data)
+{
+    overlay_call *call = data;
+    gboolean result    = call->func(call->data);
+
+    g_mutex_lock(&call_mutex);
+    call->result = result;
+    call->done   = TRUE;
+    g_cond_broadcast(&call_cond);
+    g_mutex_unlock(&call_mutex);
+
+    return G_SOURCE_REMOVE;
+}
+
 static void render_overlay_cb(gpointer render_context, gint id,
                    struct axoverlay_stream_data *stream,
                    enum axoverlay_position_type postype, gfloat overlay_x,
@@ -103,62 +746,45 @@ static void render_overlay_cb(gpointer render_context, gint id,
 
     overlay_handle handle = user_data;
 
+    if (handle->overlay_id == NO_OVERLAY) {
+        return;
+    }
+
     /* Clear background */
     cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.0);
     cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-    cairo_rectangle(cr, 0, 0, OVERLAY_WIDTH, OVERLAY_HEIGHT);
+    cairo_rectangle(cr, 0, 0, overlay_width, overlay_height);
     cairo_fill(cr);
 
-    /* Draw the text */
-    cairo_set_source_rgba(cr, 0.2, 0.8, 1.0, 1.0);
-    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-
-    cairo_select_font_face(cr, "sans-serif",
-      CAIRO_FONT_SLANT_NORMAL,
-      CAIRO_FONT_WEIGHT_BOLD);
-    cairo_set_font_size(cr, 40);
-
-    cairo_move_to(cr, 0, 40);
-    cairo_show_text(cr, handle->analytic_text);
+    stream_layout *layout = get_layout(handle, stream, overlay_width,
+        overlay_height);
 
-    /* Don't add metadata in case the timer elapsed */
-    if (handle->timer_elapsed == TRUE) {
-        return;
+    /**
+     * Composite the pre-rendered text in the text color, or write the
+     * quantized palette indexes in all channels for a palette overlay.
+     */
+    if (handle->palette) {
+        cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 1.0);
+    } else {
+        cairo_set_source_rgba(cr, TEXT_RED / 255.0, TEXT_GREEN / 255.0,
+            TEXT_BLUE / 255.0, 1.0);
     }
 
-    GList *list = handle->cur_list;
-    int offset = 90;
-    for (; list != NULL; list = list->next) {
-        mdp_item_pair *item_pair = list->data;
-        gchar *text = g_strdup_printf("%s : %s", item_pair->name,
-            item_pair->value);
-
-        cairo_move_to(cr, 0, offset);
-        cairo_show_text(cr, text);
-        offset += 50;
-
-        g_free(text);
-    }
+    cairo_mask_surface(cr, layout->mask, 0, 0);
 }
 
 
 /******************** LOCAL FUNCTION DEFINTION SECTION ************************/
 
-
-/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
-
 /**
- * Initialize overlays
+ * Initialize axoverlay, on the overlay thread so axoverlay dispatches on
+ * the overlay context.
  */
-overlay_handle overlay_init()
+static gboolean start_axoverlay_cb(gpointer data)
 {
     GError *error = NULL;
 
-    /* Create AxOverlay backend using Cairo */
-    if(!axoverlay_is_backend_supported(AXOVERLAY_CAIRO_IMAGE_BACKEND)) {
-        ERR("AXOVERLAY_CAIRO_IMAGE_BACKEND is not supported");
-        return NULL;
-    }
+    (void) data;
 
     /* Initialize the library */
     struct axoverlay_settings settings;
@@ -168,59 +794,218 @@ overlay_handle overlay_init()
         settings.select_callback = NULL;
         settings.backend = AXOVERLAY_CAIRO_IMAGE_BACKEND;
     axoverlay_init(&settings, &error);
-    
+
     if (error != NULL) {
         ERR("Failed to initialize axoverlay: %s", error->message);
         g_error_free(error);
-        return NULL;
+        return FALSE;
     }
 
-    overlay_handle handle   = g_new0(overlay, 1);
+    return TRUE;
+}
 
-    /* Create an overlay */
-    struct axoverlay_overlay_data data;
-    axoverlay_init_overlay_data(&data);
-    data.postype = AXOVERLAY_CUSTOM_SOURCE;
-    data.anchor_point = AXOVERLAY_ANCHOR_TOP_LEFT;
-    data.x = 0.0;
-    data.y = 0.0;
-    data.width = OVERLAY_WIDTH;
-    data.height = OVERLAY_WIDTH;
-    data.colorspace = AXOVERLAY_COLORSPACE_ARGB32;
-    data.scale_to_stream = TRUE;
-    handle->overlay_id = axoverlay_create_overlay(&data, handle, &error);
-    if (error != NULL) {
-        printf("Failed to create first overlay: %s", error->message);
-        g_free(handle);
-        g_error_free(error);
-        return NULL;
+/**
+ * Release axoverlay once the last overlay is gone.
+ */
+static gboolean stop_axoverlay_cb(gpointer data)
+{
+    (void) data;
+
+    /* Release library resources */
+    axoverlay_cleanup();
+
+    return TRUE;
+}
+
+/**
+ * Create the overlay of a channel and draw it.
+ */
+static gboolean create_overlay_cb(gpointer data)
+{
+    overlay_handle handle = data;
+    GError *error         = NULL;
+
+    if (!create_overlay(handle, FALSE)) {
+        return FALSE;
     }
 
-        /* Draw overlays */
+    /**
+     * Publishing only arms the wake source, so producers never allocate a
+     * source to wake the overlay thread.
+     */
+    handle->wake_source = g_source_new(&wake_source_funcs, sizeof(GSource));
+    g_source_set_callback(handle->wake_source, wake_overlay_cb, handle, NULL);
+    g_source_attach(handle->wake_source, context);
+
+    /* Draw overlays */
     axoverlay_redraw(&error);
     if (error != NULL) {
-        printf("Failed to draw overlays: %s", error->message);
-        axoverlay_destroy_overlay(handle->overlay_id, &error);
-        axoverlay_cleanup();
-        g_free(handle);
+        ERR("Failed to draw overlays: %s", error->message);
+        axoverlay_destroy_overlay(handle->overlay_id, NULL);
+        handle->overlay_id = NO_OVERLAY;
+        remove_source(&handle->wake_source);
         g_error_free(error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Destroy the overlay of a channel. Calls are dispatched in order, so
+ * updates queued for the overlay before have already run.
+ */
+static gboolean destroy_overlay_cb(gpointer data)
+{
+    overlay_handle handle = data;
+
+    remove_source(&handle->wake_source);
+    remove_source(&handle->update_source);
+    remove_source(&handle->expiry_timer);
+
+    if (handle->overlay_id != NO_OVERLAY) {
+        axoverlay_destroy_overlay(handle->overlay_id, NULL);
+        handle->overlay_id = NO_OVERLAY;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Run a function on the overlay thread and wait for its result. Only
+ * called from the GMainLoop, never from the overlay thread itself.
+ */
+static gboolean call_overlay_thread(overlay_func func, gpointer data)
+{
+    overlay_call call = {
+        .func   = func,
+        .data   = data,
+        .result = FALSE,
+        .done   = FALSE,
+    };
+
+    g_main_context_invoke(context, run_call_cb, &call);
+
+    g_mutex_lock(&call_mutex);
+    while (!call.done) {
+        g_cond_wait(&call_cond, &call_mutex);
+    }
+    g_mutex_unlock(&call_mutex);
+
+    return call.result;
+}
+
+/**
+ * Overlay thread, run the overlay context until stopped.
+ */
+static gpointer overlay_thread(gpointer data)
+{
+    (void) data;
+
+    g_main_context_push_thread_default(context);
+    g_main_loop_run(loop);
+    g_main_context_pop_thread_default(context);
+
+    return NULL;
+}
+
+/**
+ * Stop the overlay thread. Quit from inside the loop, it may not have
+ * started running yet.
+ */
+static void stop_overlay_thread(void)
+{
+    g_main_context_invoke(context, quit_overlay_cb, NULL);
+    g_thread_join(thread);
+
+    g_main_loop_unref(loop);
+    g_main_context_unref(context);
+
+    thread  = NULL;
+    loop    = NULL;
+    context = NULL;
+}
+
+/**
+ * Start the overlay thread and initialize axoverlay on it.
+ */
+static gboolean start_overlay_thread(void)
+{
+    /* Create AxOverlay backend using Cairo */
+    if(!axoverlay_is_backend_supported(AXOVERLAY_CAIRO_IMAGE_BACKEND)) {
+        ERR("AXOVERLAY_CAIRO_IMAGE_BACKEND is not supported");
+        return FALSE;
+    }
+
+    context = g_main_context_new();
+    loop    = g_main_loop_new(context, FALSE);
+    thread  = g_thread_new("overlay", overlay_thread, NULL);
+
+    if (!call_overlay_thread(start_axoverlay_cb, NULL)) {
+        stop_overlay_thread();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
+
+/**
+ * Initialize the overlay of a channel, starting the overlay thread for the
+ * first one.
+ */
+overlay_handle overlay_init(guint camera)
+{
+    if (n_overlays == 0 && !start_overlay_thread()) {
         return NULL;
     }
 
+    overlay_handle handle   = g_new0(overlay, 1);
+
+    g_mutex_init(&handle->mutex);
+
     /**
-     * Initialize state
+     * Initialize state, the overlay starts out minimal and grows with the
+     * text shown.
      */
-    handle->cur_list        = NULL;
+    handle->pending         = NULL;
+    handle->wake_source     = NULL;
+    handle->free_snapshots  = NULL;
+    handle->palette_request = FALSE;
+    handle->camera          = camera;
+    handle->analytic        = NULL;
+    handle->category        = NULL;
     handle->analytic_text   = NULL;
-    handle->timeout_us      = 3e6;
+    handle->shown           = NULL;
+    handle->update_source   = NULL;
+    handle->last_update     = 0;
+    handle->expiry_timer    = NULL;
+    handle->overlay_id      = NO_OVERLAY;
     handle->timer_elapsed   = TRUE;
+    handle->generation      = 0;
+    handle->frame           = 0;
+    handle->width           = SIZE_ALIGN;
+    handle->height          = SIZE_ALIGN;
+    handle->palette         = FALSE;
 
-    /* Start animation timer */
-    handle->animation_timer = 
-        g_timeout_add(1000/ANIMATION_FPS, update_overlay_cb, handle);
+    if (!call_overlay_thread(create_overlay_cb, handle)) {
+        g_mutex_clear(&handle->mutex);
+        g_free(handle);
+
+        if (n_overlays == 0) {
+            (void) call_overlay_thread(stop_axoverlay_cb, NULL);
+            stop_overlay_thread();
+        }
+
+        return NULL;
+    }
+
+    n_overlays++;
 
     return handle;
 }
+
 /**
  * Cleanup overlays
  */
@@ -236,19 +1021,41 @@ void overlay_cleanup(overlay_handle *handle_p)
 
     overlay_handle handle = *handle_p;
 
-    g_free(handle->analytic_text);
-    axoverlay_destroy_overlay(handle->overlay_id, NULL);
+    (void) call_overlay_thread(destroy_overlay_cb, handle);
 
-    /* The data list is owned by our creator so do not free that */
+    /* The overlay is detached by the caller so nothing is published any more */
+    free_snapshot(handle, swap_pending(handle, NULL));
+    free_snapshot(handle, handle->shown);
 
-    /* Release library resources */
-    axoverlay_cleanup();
+    while (handle->free_snapshots != NULL) {
+        overlay_snapshot *snapshot = handle->free_snapshots;
+        handle->free_snapshots     = snapshot->next;
+        g_free(snapshot);
+    }
 
-    handle = NULL;
+    guint i = 0;
+    for (; i < MAX_LAYOUTS; i++) {
+        if (handle->layouts[i].mask != NULL) {
+            cairo_surface_destroy(handle->layouts[i].mask);
+        }
+    }
+
+    g_mutex_clear(&handle->mutex);
+    g_free(handle);
+
+    if (--n_overlays == 0) {
+        (void) call_overlay_thread(stop_axoverlay_cb, NULL);
+        stop_overlay_thread();
+    }
+
+    *handle_p = NULL;
 }
 
+/**
+ * Publish new content to the overlay thread.
+ */
 gboolean overlay_set_data(const overlay_handle handle,
-                          GList *list,
+                          mdp_record *items,
                           unsigned int time,
                           const char *analytic,
                           const char *category)
@@ -260,17 +1067,65 @@ gboolean overlay_set_data(const overlay_handle handle,
         return FALSE;
     }
 
-    g_free(handle->analytic_text);
+    /**
+     * Labels are interned so only build the text when they change. The
+     * display stage and the HUD may both publish while the mode switches.
+     */
+    g_mutex_lock(&handle->mutex);
+
+    if (analytic != handle->analytic || category != handle->category) {
+        gchar *text = NULL;
+
+        if (*category == '\0' || g_strcmp0(category, "Uncategorized") == 0) {
+            text = g_strdup_printf("%s:", analytic);
+        } else {
+            text = g_strdup_printf("%s/%s:", analytic, category);
+        }
+
+        handle->analytic      = analytic;
+        handle->category      = category;
+        handle->analytic_text = g_intern_string(text);
+
+        g_free(text);
+    }
+
+    const gchar *analytic_text = handle->analytic_text;
+
+    g_mutex_unlock(&handle->mutex);
+
+    /* Keep our own reference, the caller may drop its one at any time */
+    overlay_snapshot *snapshot = new_snapshot(handle);
+    snapshot->items            = mdp_record_ref(items);
+    snapshot->analytic_text    = analytic_text;
+    snapshot->time             = time;
 
-    if (g_strcmp0(category, "Uncategorized")) {
-        handle->analytic_text = g_strdup_printf("%s:", analytic);
+    overlay_snapshot *replaced = swap_pending(handle, snapshot);
+
+    /**
+     * The overlay thread is only woken when the slot was empty, otherwise
+     * it already has an update coming and takes this snapshot instead of
+     * the replaced one.
+     */
+    if (replaced != NULL) {
+        free_snapshot(handle, replaced);
     } else {
-        handle->analytic_text = g_strdup_printf("%s/%s:", analytic, category); 
+        g_source_set_ready_time(handle->wake_source, 0);
     }
 
-    handle->cur_list = list;
+    return TRUE;
+}
 
-    reset_clock(handle);
+/**
+ * Request a colorspace switch from the overlay thread.
+ */
+gboolean overlay_set_palette(const overlay_handle handle, gboolean palette)
+{
+    if (handle == NULL) {
+        return FALSE;
+    }
+
+    g_atomic_int_set(&handle->palette_request, palette);
+    g_main_context_invoke(context, palette_overlay_cb, handle);
 
     return TRUE;
-}
\ No newline at end of file
+}
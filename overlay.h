@@ -4,6 +4,9 @@
 /** @file overlay.h
  * @Brief Responsible for updating overlays with metadata information
  *
+ * The overlays run on their own thread. overlay_set_data() may be called
+ * from any thread, the other functions from the GMainLoop. There is one
+ * overlay per channel, shown on the streams of its camera.
  */
 
 /**
@@ -12,27 +15,54 @@
 typedef struct overlay* overlay_handle;
 
 /**
+ * Create an overlay. The overlay thread is started with the first one.
+ *
+ * @param camera Camera the overlay is shown on, 1 for the first one, or 0
+ *               to show it on all cameras.
+ *
+ * @return Handle for the overlay, NULL on failure.
  */
-overlay_handle overlay_init();
+overlay_handle overlay_init(guint camera);
 
 /**
- * Cleanup Metadata Push framework and deallocate resources.
+ * Destroy an overlay and deallocate resources. The overlay thread is
+ * stopped with the last one.
+ *
+ * @param handle_p Pointer to the handle, set to NULL on return.
  *
  * @return No return value.
  */
 void overlay_cleanup(overlay_handle *handle_p);
 
 /**
- * Send Metadata to ACS.
+ * Set the metadata shown in the overlay.
  *
- * @param data the set of strings to update the overlay with
+ * @param metadata_items Record of metadata items to show, the overlay takes
+ *                       its own reference and releases it on the next update.
+ * @param time           Time in ms the items are shown, 0 to show them until
+ *                       the next update. Updates are coalesced to a max rate
+ *                       and only the latest one is shown.
+ * @param analytic       Analytic label, an interned string (g_intern_string).
+ * @param category       Category label, an interned string (g_intern_string).
  *
  * @return TRUE on success, FALSE on any kind of error.
  */
 gboolean overlay_set_data(const overlay_handle handle,
-						  GList *metadata_items, 
+						  mdp_record *metadata_items, 
 						  unsigned int time,
 						  const char *analytic, 
 						  const char *category);
 
+/**
+ * Select the colorspace of the overlay. A 4-bit palette overlay takes an
+ * eighth of the memory of an ARGB32 one. The switch is made on the overlay
+ * thread, if the palette is not supported ARGB32 is kept.
+ *
+ * @param handle  The overlay.
+ * @param palette TRUE for the 4-bit palette colorspace, FALSE for ARGB32.
+ *
+ * @return TRUE if requested, FALSE if there is no overlay.
+ */
+gboolean overlay_set_palette(const overlay_handle handle, gboolean palette);
+
 #endif // INCLUSION_GUARD_OVERLAY_H
\ No newline at end of file
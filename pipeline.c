@@ -0,0 +1,534 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gprintf.h>
+
+#include <syslog.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "pipeline.h"
+#include "debug.h"
+
+/** @file pipeline.c
+ * @Brief Implementation of the event processing pipeline.
+ *
+ * The ring indexes are free running counters, the slot is the counter masked
+ * with capacity - 1. The producer only writes head and the consumer only
+ * writes tail so no lock is needed to pass records. The mutex and condition
+ * are only used to park the consumer when the ring is empty.
+ *
+ * Each record gets a sequence number and one of a fixed number of in-flight
+ * items when it leaves the ring. Ordered stages keep a reorder window indexed
+ * by sequence number. Since no more than capacity records are in flight the
+ * sequence numbers waiting in a window never collide. An ordered stage only
+ * takes the next record from its window when the previous one is done, so
+ * its records are processed one at a time and in order whatever the number
+ * of pool threads.
+ */
+
+/******************** MACRO DEFINITION SECTION ********************************/
+
+/**
+ * Log every this many dropped records to not flood syslog under overload.
+ */
+#define DROP_LOG_INTERVAL (100)
+
+/******************** LOCAL VARIABLE DECLARATION SECTION **********************/
+
+/**
+ * A record in flight through the stages.
+ */
+typedef struct pipeline_item
+{
+    guint    seq;
+    gpointer record;
+    gboolean skip;
+} pipeline_item;
+
+typedef struct stage
+{
+    struct pipeline  *pipeline;
+    guint            index;
+    pipeline_process process;
+    gboolean         ordered;
+    GThreadPool      *pool;
+    GMutex           mutex;
+    guint            next_seq;
+    gboolean         busy;
+    pipeline_item    **window;
+} stage;
+
+typedef struct pipeline
+{
+    gpointer         *slots;
+    guint            mask;
+    volatile gint    head;
+    volatile gint    tail;
+    volatile gint    dropped;
+    volatile gint    running;
+    volatile gint    sleeping;
+    GMutex           mutex;
+    GCond            cond;
+    GThread          *thread;
+
+    stage            *stages;
+    guint            n_stages;
+    pipeline_item    *items;
+    pipeline_item    **free_items;
+    guint            n_free;
+    GMutex           item_mutex;
+    GCond            item_cond;
+    guint            next_seq;
+
+    GDestroyNotify   free_record;
+    gpointer         user_data;
+} pipeline;
+
+/******************** LOCAL FUNCTION DECLARATION SECTION **********************/
+
+/**
+ * Dispatcher thread, consume the ring until stopped.
+ *
+ * @param data The pipeline handle.
+ *
+ * @return Always NULL.
+ */
+static gpointer pipeline_thread(gpointer data);
+
+/**
+ * Pop the oldest record from the ring, consumer side only.
+ *
+ * @param handle The pipeline.
+ *
+ * @return The record or NULL if the ring is empty.
+ */
+static gpointer ring_pop(const pipeline_handle handle);
+
+/**
+ * Hand an item to a stage, or finish it after the last stage.
+ *
+ * @param handle The pipeline.
+ * @param index  Index of the stage to enter.
+ * @param item   The item.
+ *
+ * @return No return value.
+ */
+static void stage_enter(const pipeline_handle handle, guint index,
+                        pipeline_item *item);
+
+/**
+ * Take the next item in sequence from the window of an ordered stage. Must
+ * be called with the stage mutex held.
+ *
+ * @param handle The pipeline.
+ * @param s      The stage.
+ *
+ * @return The item, NULL if it has not reached the stage yet.
+ */
+static pipeline_item *window_take(const pipeline_handle handle, stage *s);
+
+/**
+ * Thread pool function running a stage on one item.
+ *
+ * @param data      The item.
+ * @param user_data The stage.
+ *
+ * @return No return value.
+ */
+static void stage_worker(gpointer data, gpointer user_data);
+
+/******************** LOCAL FUNCTION DEFINTION SECTION ************************/
+
+/**
+ * Pop the oldest record from the ring.
+ */
+static gpointer ring_pop(const pipeline_handle handle)
+{
+    guint tail = (guint) g_atomic_int_get(&handle->tail);
+
+    if (tail == (guint) g_atomic_int_get(&handle->head)) {
+        return NULL;
+    }
+
+    gpointer record = handle->slots[tail & handle->mask];
+
+    /* Release the slot to the producer */
+    g_atomic_int_set(&handle->tail, (gint) (tail + 1));
+
+    return record;
+}
+
+/**
+ * Take a free in-flight item, blocks while all items are in flight.
+ */
+static pipeline_item *item_take(const pipeline_handle handle)
+{
+    g_mutex_lock(&handle->item_mutex);
+
+    while (handle->n_free == 0) {
+        g_cond_wait(&handle->item_cond, &handle->item_mutex);
+    }
+
+    pipeline_item *item = handle->free_items[--handle->n_free];
+
+    g_mutex_unlock(&handle->item_mutex);
+
+    return item;
+}
+
+/**
+ * Return an in-flight item after the last stage.
+ */
+static void item_release(const pipeline_handle handle, pipeline_item *item)
+{
+    g_mutex_lock(&handle->item_mutex);
+    handle->free_items[handle->n_free++] = item;
+    g_cond_broadcast(&handle->item_cond);
+    g_mutex_unlock(&handle->item_mutex);
+}
+
+/**
+ * Take the next item in sequence from the window.
+ */
+static pipeline_item *window_take(const pipeline_handle handle, stage *s)
+{
+    pipeline_item *item = s->window[s->next_seq & handle->mask];
+
+    if (item == NULL || item->seq != s->next_seq) {
+        return NULL;
+    }
+
+    s->window[s->next_seq & handle->mask] = NULL;
+    s->next_seq++;
+
+    return item;
+}
+
+/**
+ * Hand an item to a stage. Ordered stages only start an item when all items
+ * with lower sequence numbers have been processed by the stage.
+ */
+static void stage_enter(const pipeline_handle handle, guint index,
+                        pipeline_item *item)
+{
+    if (index == handle->n_stages) {
+        handle->free_record(item->record);
+        item->record = NULL;
+        item_release(handle, item);
+        return;
+    }
+
+    stage *s = &handle->stages[index];
+
+    if (!s->ordered) {
+        g_thread_pool_push(s->pool, item, NULL);
+        return;
+    }
+
+    g_mutex_lock(&s->mutex);
+
+    s->window[item->seq & handle->mask] = item;
+
+    /* A busy stage takes the next item itself when it is done */
+    item = s->busy ? NULL : window_take(handle, s);
+
+    if (item != NULL) {
+        s->busy = TRUE;
+    }
+
+    g_mutex_unlock(&s->mutex);
+
+    if (item != NULL) {
+        g_thread_pool_push(s->pool, item, NULL);
+    }
+}
+
+/**
+ * Thread pool function running a stage on one item.
+ */
+static void stage_worker(gpointer data, gpointer user_data)
+{
+    pipeline_item *item = data;
+    stage *s            = user_data;
+
+    pipeline_item *next = NULL;
+
+    if (!item->skip) {
+        item->skip = !s->process(item->record, s->pipeline->user_data);
+    }
+
+    /* Completion, not dispatch, moves an ordered stage on */
+    if (s->ordered) {
+        g_mutex_lock(&s->mutex);
+        next    = window_take(s->pipeline, s);
+        s->busy = next != NULL;
+        g_mutex_unlock(&s->mutex);
+    }
+
+    stage_enter(s->pipeline, s->index + 1, item);
+
+    if (next != NULL) {
+        g_thread_pool_push(s->pool, next, NULL);
+    }
+}
+
+/**
+ * Dispatcher thread, consume the ring until stopped.
+ */
+static gpointer pipeline_thread(gpointer data)
+{
+    pipeline_handle handle = data;
+
+    while (g_atomic_int_get(&handle->running)) {
+        if (g_atomic_int_get(&handle->tail) !=
+            g_atomic_int_get(&handle->head)) {
+            /* Wait for a free item before taking the record off the ring */
+            pipeline_item *item = item_take(handle);
+
+            item->record = ring_pop(handle);
+            item->seq    = handle->next_seq++;
+            item->skip   = FALSE;
+
+            stage_enter(handle, 0, item);
+            continue;
+        }
+
+        /* Ring empty, park until the producer signals */
+        g_mutex_lock(&handle->mutex);
+        g_atomic_int_set(&handle->sleeping, TRUE);
+
+        while (g_atomic_int_get(&handle->running) &&
+            g_atomic_int_get(&handle->tail) ==
+            g_atomic_int_get(&handle->head)) {
+            g_cond_wait(&handle->cond, &handle->mutex);
+        }
+
+        g_atomic_int_set(&handle->sleeping, FALSE);
+        g_mutex_unlock(&handle->mutex);
+    }
+
+    return NULL;
+}
+
+/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
+
+/**
+ * Create pipeline and start the pipeline threads.
+ */
+pipeline_handle pipeline_init(guint capacity,
+                              const pipeline_stage *stages,
+                              guint n_stages,
+                              GDestroyNotify free_record,
+                              gpointer user_data)
+{
+    g_assert(stages);
+    g_assert(free_record);
+
+    GError *error = NULL;
+    guint size    = 1;
+    guint i;
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    pipeline_handle handle = g_new0(pipeline, 1);
+
+    handle->slots       = g_new0(gpointer, size);
+    handle->mask        = size - 1;
+    handle->running     = TRUE;
+    handle->free_record = free_record;
+    handle->user_data   = user_data;
+
+    handle->items       = g_new0(pipeline_item, size);
+    handle->free_items  = g_new0(pipeline_item *, size);
+
+    for (i = 0; i < size; i++) {
+        handle->free_items[handle->n_free++] = &handle->items[i];
+    }
+
+    g_mutex_init(&handle->mutex);
+    g_cond_init(&handle->cond);
+    g_mutex_init(&handle->item_mutex);
+    g_cond_init(&handle->item_cond);
+
+    handle->stages   = g_new0(stage, n_stages);
+    handle->n_stages = n_stages;
+
+    for (i = 0; i < n_stages; i++) {
+        stage *s    = &handle->stages[i];
+        s->pipeline = handle;
+        s->index    = i;
+        s->process  = stages[i].process;
+        s->ordered  = stages[i].ordered;
+        s->window   = g_new0(pipeline_item *, size);
+
+        g_mutex_init(&s->mutex);
+
+        s->pool = g_thread_pool_new(stage_worker, s,
+            s->ordered ? 1 : MAX(stages[i].concurrency, 1), FALSE, &error);
+
+        if (error != NULL) {
+            ERR("Failed to create %s stage: %s", stages[i].name,
+                error->message);
+            g_error_free(error);
+            pipeline_cleanup(&handle);
+            return NULL;
+        }
+    }
+
+    handle->thread = g_thread_try_new("pipeline", pipeline_thread, handle,
+        &error);
+
+    if (error != NULL) {
+        ERR("Failed to start pipeline thread: %s", error->message);
+        g_error_free(error);
+        g_atomic_int_set(&handle->running, FALSE);
+        pipeline_cleanup(&handle);
+        return NULL;
+    }
+
+    return handle;
+}
+
+/**
+ * Stop the pipeline threads and free what is left.
+ */
+void pipeline_cleanup(pipeline_handle *handle_p)
+{
+    if (handle_p == NULL) {
+        return;
+    }
+
+    if (*handle_p == NULL) {
+        return;
+    }
+
+    pipeline_handle handle = *handle_p;
+    guint i;
+
+    g_mutex_lock(&handle->mutex);
+    g_atomic_int_set(&handle->running, FALSE);
+    g_cond_signal(&handle->cond);
+    g_mutex_unlock(&handle->mutex);
+
+    if (handle->thread) {
+        g_thread_join(handle->thread);
+    }
+
+    /* Let records in flight pass all stages */
+    g_mutex_lock(&handle->item_mutex);
+    while (handle->n_free <= handle->mask) {
+        g_cond_wait(&handle->item_cond, &handle->item_mutex);
+    }
+    g_mutex_unlock(&handle->item_mutex);
+
+    for (i = 0; i < handle->n_stages; i++) {
+        stage *s = &handle->stages[i];
+
+        if (s->pool) {
+            g_thread_pool_free(s->pool, FALSE, TRUE);
+        }
+
+        g_mutex_clear(&s->mutex);
+        g_free(s->window);
+    }
+
+    gpointer record;
+    while ((record = ring_pop(handle)) != NULL) {
+        handle->free_record(record);
+    }
+
+    g_mutex_clear(&handle->mutex);
+    g_cond_clear(&handle->cond);
+    g_mutex_clear(&handle->item_mutex);
+    g_cond_clear(&handle->item_cond);
+    g_free(handle->stages);
+    g_free(handle->items);
+    g_free(handle->free_items);
+    g_free(handle->slots);
+    g_free(handle);
+
+    *handle_p = NULL;
+}
+
+/**
+ * Push record to the ring, producer side only.
+ */
+gboolean pipeline_push(const pipeline_handle handle, gpointer record)
+{
+    g_assert(record);
+
+    if (handle == NULL) {
+        return FALSE;
+    }
+
+    guint head = (guint) g_atomic_int_get(&handle->head);
+
+    if (head - (guint) g_atomic_int_get(&handle->tail) > handle->mask) {
+        gint dropped = g_atomic_int_add(&handle->dropped, 1);
+
+        if (dropped % DROP_LOG_INTERVAL == 0) {
+            LOG("Pipeline full, dropped %d events so far", dropped + 1);
+        }
+
+        handle->free_record(record);
+        return FALSE;
+    }
+
+    handle->slots[head & handle->mask] = record;
+
+    /* Publish the record to the consumer */
+    g_atomic_int_set(&handle->head, (gint) (head + 1));
+
+    if (g_atomic_int_get(&handle->sleeping)) {
+        g_mutex_lock(&handle->mutex);
+        g_cond_signal(&handle->cond);
+        g_mutex_unlock(&handle->mutex);
+    }
+
+    return TRUE;
+}
+
+/**
+ * Change the number of worker threads of a stage.
+ */
+void pipeline_set_concurrency(const pipeline_handle handle,
+                              guint stage,
+                              guint concurrency)
+{
+    if (handle == NULL || stage >= handle->n_stages ||
+        handle->stages[stage].pool == NULL ||
+        handle->stages[stage].ordered) {
+        return;
+    }
+
+    g_thread_pool_set_max_threads(handle->stages[stage].pool,
+        MAX(concurrency, 1), NULL);
+}
+
+/**
+ * Get number of records waiting in the ring.
+ */
+guint pipeline_get_depth(const pipeline_handle handle)
+{
+    if (handle == NULL) {
+        return 0;
+    }
+
+    return (guint) g_atomic_int_get(&handle->head) -
+        (guint) g_atomic_int_get(&handle->tail);
+}
+
+/**
+ * Get number of dropped records.
+ */
+guint pipeline_get_dropped(const pipeline_handle handle)
+{
+    if (handle == NULL) {
+        return 0;
+    }
+
+    return (guint) g_atomic_int_get(&handle->dropped);
+}
@@ -0,0 +1,116 @@
+#ifndef INCLUSION_GUARD_PIPELINE_H
+#define INCLUSION_GUARD_PIPELINE_H
+
+#include <glib.h>
+
+/** @file pipeline.h
+ * @Brief Event processing pipeline running off the GMainLoop.
+ *
+ * The event callback pushes records into a preallocated single-producer /
+ * single-consumer ring and returns. A dispatcher thread consumes the ring
+ * and feeds the records through a number of stages, each running on its own
+ * pool of worker threads with configurable concurrency. Ordered stages
+ * process their records one at a time, in the order they were pushed, on a
+ * single thread. When all records are in flight the dispatcher stops
+ * consuming, the ring fills up and new records are dropped and counted
+ * instead of stalling the main loop.
+ */
+
+/**
+ * Forward-declared handle for pipeline object.
+ */
+typedef struct pipeline* pipeline_handle;
+
+/**
+ * Function run on a stage worker thread for every record.
+ *
+ * @param record    The record pushed by the producer.
+ * @param user_data User data given to pipeline_init().
+ *
+ * @return TRUE to pass the record on, FALSE to skip the remaining stages.
+ */
+typedef gboolean (*pipeline_process)(gpointer record, gpointer user_data);
+
+/**
+ * Description of one pipeline stage.
+ */
+typedef struct pipeline_stage
+{
+    const char       *name;
+    pipeline_process process;
+    guint            concurrency;
+    gboolean         ordered;
+} pipeline_stage;
+
+/**
+ * Create pipeline and start the pipeline threads.
+ *
+ * @param capacity    Number of records the ring and the stages can hold,
+ *                    rounded up to a power of two.
+ * @param stages      The stages every record is run through, in order.
+ * @param n_stages    Number of stages.
+ * @param free_record Function freeing a record after it has passed the last
+ *                    stage or has been dropped.
+ * @param user_data   User data passed on to the stage functions.
+ *
+ * @return Handle for the pipeline, NULL on failure.
+ */
+pipeline_handle pipeline_init(guint capacity,
+                              const pipeline_stage *stages,
+                              guint n_stages,
+                              GDestroyNotify free_record,
+                              gpointer user_data);
+
+/**
+ * Stop the pipeline threads, let records in flight finish and free records
+ * still in the ring.
+ *
+ * @param handle_p Pointer to the handle, set to NULL on return.
+ *
+ * @return No return value.
+ */
+void pipeline_cleanup(pipeline_handle *handle_p);
+
+/**
+ * Push a record to the pipeline. Must only be called from one thread.
+ *
+ * @param handle The pipeline.
+ * @param record The record, owned by the pipeline after the call.
+ *
+ * @return TRUE if queued, FALSE if the ring was full and the record dropped.
+ */
+gboolean pipeline_push(const pipeline_handle handle, gpointer record);
+
+/**
+ * Change the number of worker threads of a stage.
+ *
+ * @param handle      The pipeline.
+ * @param stage       Index of the stage.
+ * @param concurrency New number of worker threads, at least one. Ignored
+ *                    for ordered stages.
+ *
+ * @return No return value.
+ */
+void pipeline_set_concurrency(const pipeline_handle handle,
+                              guint stage,
+                              guint concurrency);
+
+/**
+ * Get number of records waiting in the ring.
+ *
+ * @param handle The pipeline.
+ *
+ * @return Current queue depth.
+ */
+guint pipeline_get_depth(const pipeline_handle handle);
+
+/**
+ * Get number of records dropped because the ring was full.
+ *
+ * @param handle The pipeline.
+ *
+ * @return Total number of dropped records.
+ */
+guint pipeline_get_dropped(const pipeline_handle handle);
+
+#endif // INCLUSION_GUARD_PIPELINE_H
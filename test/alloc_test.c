@@ -0,0 +1,418 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <glib/gprintf.h>
+#include <axoverlay.h>
+
+#include <malloc.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "metadata_pair.h"
+#include "item_plan.h"
+#include "content_filter.h"
+#include "overlay.h"
+#include "acs.h"
+
+/** @file alloc_test.c
+ * @Brief Allocation regression gate for the event path.
+ *
+ * Runs events through the filter, extraction, ACS encoding and overlay
+ * publishing, the work done per event between the AXEvent callback and
+ * the send. After a warm-up no heap allocation may be made on the event
+ * thread, and the heap must not keep growing over the measured rounds.
+ *
+ * malloc and friends are interposed by defining them here, so allocations
+ * made inside GLib are counted too. They forward to the glibc allocator.
+ * Only the event thread is counted, the overlay thread is allowed to
+ * allocate while it draws, it only shows up in the heap size.
+ *
+ * The AXEvent getters, the GThreadPool hand-over between the stages and
+ * the curl spawn are not run, they allocate inside the SDK and GLib. A ~=
+ * regex test in the filter allocates inside GRegex, so the filter used
+ * here has none. axoverlay is stubbed, there is no video to draw on.
+ */
+
+/******************** MACRO DEFINITION SECTION ********************************/
+
+/**
+ * Number of events run before measuring, fills the record and snapshot
+ * pools and grows the command buffer.
+ */
+#define WARMUP_EVENTS (1000)
+
+/**
+ * Number of measured rounds and events per round.
+ */
+#define ROUNDS       (5)
+#define ROUND_EVENTS (1000)
+
+/**
+ * Time in ms given to the overlay thread to settle before the heap is
+ * measured, longer than the overlay update interval.
+ */
+#define SETTLE_TIME  (300)
+
+/******************** LOCAL VARIABLE DECLARATION SECTION **********************/
+
+/**
+ * One key of the stub event.
+ */
+typedef struct stub_value
+{
+    const gchar         *key;
+    content_filter_type type;
+    const gchar         *string;
+    gint                integer;
+    gdouble             number;
+    gboolean            boolean;
+} stub_value;
+
+static const stub_value event_values[] = {
+    { "plate",   CONTENT_FILTER_TYPE_STRING,  "ABC123", 0,  0.0,  FALSE },
+    { "country", CONTENT_FILTER_TYPE_STRING,  "SE",     0,  0.0,  FALSE },
+    { "speed",   CONTENT_FILTER_TYPE_INTEGER, NULL,     57, 0.0,  FALSE },
+    { "conf",    CONTENT_FILTER_TYPE_DOUBLE,  NULL,     0,  0.93, FALSE },
+    { "moving",  CONTENT_FILTER_TYPE_BOOLEAN, NULL,     0,  0.0,  TRUE  },
+};
+
+/**
+ * Allocations made by the counting thread, and bytes in use by all threads.
+ */
+static __thread gboolean counting = FALSE;
+static __thread guint    n_allocs = 0;
+static volatile gint     heap_used = 0;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+/******************** LOCAL FUNCTION DECLARATION SECTION **********************/
+
+/**
+ * Content filter lookup on the stub event. Strings are borrowed from the
+ * table like ingest_lookup() borrows them from its message.
+ *
+ * @param key       Name of the key to look up.
+ * @param value     Return location for the value.
+ * @param user_data Not used.
+ *
+ * @return TRUE if the key was found, FALSE otherwise.
+ */
+static gboolean lookup_stub_value(const char *key,
+                                  content_filter_value *value,
+                                  gpointer user_data);
+
+/**
+ * Run one event the way the event callback and the pipeline stages do.
+ *
+ * @param cfg     Config snapshot with the filter, plan and ACS settings.
+ * @param ovl     The overlay.
+ * @param command Reused command buffer.
+ *
+ * @return TRUE if the event passed and was encoded, FALSE otherwise.
+ */
+static gboolean run_event(const config *cfg,
+                          const overlay_handle ovl,
+                          GString *command);
+
+/**
+ * Account an allocation, or a release with a negative size.
+ *
+ * @param ptr  The block.
+ * @param sign 1 for an allocation, -1 for a release.
+ *
+ * @return The block.
+ */
+static void *account(void *ptr, gint sign);
+
+/******************** LOCAL FUNCTION DEFINTION SECTION ************************/
+
+/**
+ * Count the block on the current thread and in the heap size.
+ */
+static void *account(void *ptr, gint sign)
+{
+    if (ptr != NULL) {
+        g_atomic_int_add(&heap_used, sign * (gint) malloc_usable_size(ptr));
+
+        if (counting && sign > 0) {
+            n_allocs++;
+        }
+    }
+
+    return ptr;
+}
+
+/**
+ * Look up a key of the stub event.
+ */
+static gboolean lookup_stub_value(const char *key,
+                                  content_filter_value *value,
+                                  gpointer user_data)
+{
+    (void) user_data;
+
+    guint i = 0;
+    for (; i < G_N_ELEMENTS(event_values); i++) {
+        const stub_value *stub = &event_values[i];
+
+        if (strcmp(stub->key, key) != 0) {
+            continue;
+        }
+
+        value->type     = stub->type;
+        value->string   = (gchar *) stub->string;
+        value->borrowed = TRUE;
+        value->integer  = stub->integer;
+        value->number   = stub->number;
+        value->boolean  = stub->boolean;
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Filter, extract, encode and publish one event.
+ */
+static gboolean run_event(const config *cfg,
+                          const overlay_handle ovl,
+                          GString *command)
+{
+    mdp_record *record = NULL;
+    gboolean ret       = FALSE;
+
+    if (!content_filter_match(cfg->content_filter, lookup_stub_value, NULL)) {
+        return FALSE;
+    }
+
+    if (!item_plan_extract(cfg->item_plan, lookup_stub_value, NULL,
+        &record)) {
+        return FALSE;
+    }
+
+    ret = acs_encode(cfg, NULL, record, g_get_real_time(), command);
+
+    (void) overlay_set_data(ovl, record, 3000,
+        g_intern_static_string("LicensePlate"),
+        g_intern_static_string("Uncategorized"));
+
+    mdp_record_unref(&record);
+
+    return ret;
+}
+
+/******************** GLOBAL FUNCTION DEFINTION SECTION ***********************/
+
+void *malloc(size_t size)
+{
+    return account(__libc_malloc(size), 1);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    return account(__libc_calloc(n, size), 1);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    (void) account(ptr, -1);
+
+    return account(__libc_realloc(ptr, size), 1);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    return account(__libc_memalign(alignment, size), 1);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return account(__libc_memalign(alignment, size), 1);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    *ptr = account(__libc_memalign(alignment, size), 1);
+
+    return *ptr == NULL ? ENOMEM : 0;
+}
+
+void free(void *ptr)
+{
+    (void) account(ptr, -1);
+
+    __libc_free(ptr);
+}
+
+/**
+ * axoverlay stubs, an overlay that is never composited.
+ */
+gboolean axoverlay_is_backend_supported(enum axoverlay_backend_type backend)
+{
+    return backend == AXOVERLAY_CAIRO_IMAGE_BACKEND;
+}
+
+void axoverlay_init_axoverlay_settings(struct axoverlay_settings *settings)
+{
+    memset(settings, 0, sizeof(*settings));
+}
+
+void axoverlay_init(struct axoverlay_settings *settings, GError **error)
+{
+    (void) settings;
+    (void) error;
+}
+
+void axoverlay_cleanup(void)
+{
+}
+
+void axoverlay_init_overlay_data(struct axoverlay_overlay_data *data)
+{
+    memset(data, 0, sizeof(*data));
+}
+
+gint axoverlay_create_overlay(struct axoverlay_overlay_data *data,
+                              gpointer user_data,
+                              GError **error)
+{
+    (void) data;
+    (void) user_data;
+    (void) error;
+
+    return 1;
+}
+
+void axoverlay_destroy_overlay(gint id, GError **error)
+{
+    (void) id;
+    (void) error;
+}
+
+void axoverlay_get_overlay_data(gint id,
+                                struct axoverlay_overlay_data *data,
+                                GError **error)
+{
+    (void) id;
+    (void) error;
+
+    memset(data, 0, sizeof(*data));
+}
+
+void axoverlay_update_overlay_data(gint id,
+                                   struct axoverlay_overlay_data *data,
+                                   GError **error)
+{
+    (void) id;
+    (void) data;
+    (void) error;
+}
+
+void axoverlay_set_palette_color(gint index,
+                                 struct axoverlay_palette_color *color,
+                                 GError **error)
+{
+    (void) index;
+    (void) color;
+    (void) error;
+}
+
+void axoverlay_redraw(GError **error)
+{
+    (void) error;
+}
+
+int main(void)
+{
+    gboolean failed = FALSE;
+
+    /* Make sure the allocator really is interposed */
+    counting = TRUE;
+    g_free(g_malloc(16));
+    counting = FALSE;
+
+    if (n_allocs != 1) {
+        printf("FAIL: malloc is not interposed\n");
+        return EXIT_FAILURE;
+    }
+
+    config *cfg   = config_edit();
+    cfg->ipname   = g_strdup("127.0.0.1");
+    cfg->source   = g_strdup("1001");
+    cfg->username = g_strdup("user");
+    cfg->password = g_strdup("pass");
+    cfg->enabled  = g_strdup("yes");
+
+    gchar *error        = NULL;
+    cfg->content_filter = content_filter_init(
+        "speed>50 AND country IN (SE, NO) AND NOT plate^=XX", &error);
+    cfg->item_plan      = item_plan_init("plate;country;speed;conf;moving;");
+    gboolean compiled   = cfg->item_plan != NULL;
+    config_publish(cfg);
+
+    overlay_handle ovl = overlay_init(0);
+    GString *command   = g_string_new(NULL);
+
+    if (error != NULL || !compiled || ovl == NULL) {
+        printf("FAIL: setup %s\n", error != NULL ? error : "");
+        return EXIT_FAILURE;
+    }
+
+    guint i = 0;
+    for (; i < WARMUP_EVENTS; i++) {
+        if (!run_event(config_get(), ovl, command)) {
+            printf("FAIL: event not encoded\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* Also lets stdio allocate its buffer before the heap is measured */
+    printf("Warm-up done after %d events\n", WARMUP_EVENTS);
+
+    g_usleep(SETTLE_TIME * 1000);
+
+    gint heap_start = g_atomic_int_get(&heap_used);
+    gint heap_end   = heap_start;
+    guint round     = 0;
+
+    for (; round < ROUNDS; round++) {
+        n_allocs = 0;
+        counting = TRUE;
+
+        for (i = 0; i < ROUND_EVENTS; i++) {
+            (void) run_event(config_get(), ovl, command);
+        }
+
+        counting = FALSE;
+
+        g_usleep(SETTLE_TIME * 1000);
+        heap_end = g_atomic_int_get(&heap_used);
+
+        printf("Round %u: %u allocations in %d events, heap %+d bytes\n",
+            round + 1, n_allocs, ROUND_EVENTS, heap_end - heap_start);
+
+        if (n_allocs > 0) {
+            failed = TRUE;
+        }
+    }
+
+    if (heap_end > heap_start) {
+        printf("FAIL: heap grew by %d bytes\n", heap_end - heap_start);
+        failed = TRUE;
+    }
+
+    g_string_free(command, TRUE);
+    overlay_cleanup(&ovl);
+    config_cleanup();
+
+    printf("%s\n", failed ? "FAIL" : "PASS");
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}